@@ -1,5 +1,15 @@
 // Include
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "engine.h"
 
 //// Variables ////
@@ -27,10 +37,316 @@ const int MagicBitboard[INDEX_SIZE] =
 u64 SetMask[INDEX_SIZE];
 u64 ClearMask[INDEX_SIZE];
 
-// Hash keys
-u64 PieceKeys[PIECE_SIZE][POSITION_SIZE];
-u64 SideKey;
-u64 CastleKeys[CASTLE_SIZE];
+// Attack masks
+u64 PawnAttacks[SIDE_SIZE][INDEX_SIZE];
+u64 KnightAttacks[INDEX_SIZE];
+u64 KingAttacks[INDEX_SIZE];
+
+// Slide attack magics
+const u64 RookMagics[INDEX_SIZE] =
+{
+  0x1080004008801020ULL, 0x0840092002c03000ULL, 0x1900200010400900ULL, 0x0880100008000480ULL,
+  0x4200100420080200ULL, 0x8100020100080400ULL, 0x0200040110886200ULL, 0x0200008040220411ULL,
+  0x0404800084400220ULL, 0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+  0x000a001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL, 0x0442000102105084ULL,
+  0x9080010020804100ULL, 0x0040404000201009ULL, 0x0000808010002009ULL, 0x2200090021d00100ULL,
+  0x0008008008040080ULL, 0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000a0001768104ULL,
+  0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL, 0x1000100080080080ULL,
+  0x0442000a00049020ULL, 0x2100040080020080ULL, 0x0800120400900148ULL, 0x0010040a00128541ULL,
+  0x2800804000800030ULL, 0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+  0x0400802402800800ULL, 0xc100020080800400ULL, 0x0002000802000401ULL, 0x0182085882000401ULL,
+  0x0220204000808000ULL, 0x2860100040024022ULL, 0x0001002004110040ULL, 0x99101042000a0020ULL,
+  0x0004080004008080ULL, 0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+  0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040a00300ULL, 0x0801100280080480ULL,
+  0x0242009008200600ULL, 0x1002000489500200ULL, 0x0040800200010080ULL, 0x0091800041000080ULL,
+  0x0000209300488001ULL, 0x04c1002414824001ULL, 0x020020000b001041ULL, 0x7000100004200901ULL,
+  0x8002002004100802ULL, 0x30010002084c0007ULL, 0x0888221800813004ULL, 0x4000002840840112ULL
+};
+
+const u64 BishopMagics[INDEX_SIZE] =
+{
+  0xa010041108003100ULL, 0x006082020a002900ULL, 0x6810010619200000ULL, 0x08281a0520000408ULL,
+  0x0001104001000400ULL, 0x0018901008048400ULL, 0x00040a0210245280ULL, 0x000200210808a402ULL,
+  0x9140048410821200ULL, 0x0800091010820041ULL, 0x20504804832202c0ULL, 0x0100091401081000ULL,
+  0x8021011140000012ULL, 0x0810020804450400ULL, 0x208b0542109008a2ULL, 0x0080084a08040204ULL,
+  0x0040e2a80811244cULL, 0x2505022008008108ULL, 0x0430220100420040ULL, 0x010a040420220040ULL,
+  0x1105000290400000ULL, 0x0093001200822120ULL, 0x4000a62048043004ULL, 0x280120048a015004ULL,
+  0x006090002a020814ULL, 0x44042000240800d0ULL, 0x01102800040a4400ULL, 0x1004080080220040ULL,
+  0x0001001011004024ULL, 0x0010044000805040ULL, 0x0914041200820100ULL, 0x0004821012821480ULL,
+  0x0024040500c05021ULL, 0x0088611002080200ULL, 0x0116080a00040020ULL, 0x4000020080080080ULL,
+  0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL, 0x8081110600002e00ULL,
+  0x2842101105000801ULL, 0x1100809008001025ULL, 0x00020202221c0400ULL, 0x0422014022009020ULL,
+  0x0210046102100c00ULL, 0xc004008082029102ULL, 0x00aa461801101200ULL, 0x0404080080201108ULL,
+  0x020542108c205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL, 0x0400200042021100ULL,
+  0x00004204850400c0ULL, 0x0200100410a42102ULL, 0x1040020801210102ULL, 0x0805040410420000ULL,
+  0x2884804130100200ULL, 0x800c262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+  0x0104000012a02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL, 0x0402020801010201ULL
+};
+
+// Slide attack tables
+Magic RookMagicTable[INDEX_SIZE];
+Magic BishopMagicTable[INDEX_SIZE];
+u64 RookAttackTable[ROOK_ATTACK_SIZE];
+u64 BishopAttackTable[BISHOP_ATTACK_SIZE];
+
+// Line masks
+u64 BetweenMask[INDEX_SIZE][INDEX_SIZE];
+u64 LineMask[INDEX_SIZE][INDEX_SIZE];
+
+// Pawn structure masks
+u64 FileMasks[FILE_X];
+u64 AdjacentFileMasks[FILE_X];
+u64 PassedMasks[SIDE_SIZE][INDEX_SIZE];
+u64 SupportMasks[SIDE_SIZE][INDEX_SIZE];
+
+// Hash keys, the first outputs of SplitMix64 seeded with 0 taken in declaration order
+const u64 PieceKeys[PIECE_SIZE][INDEX_SIZE] =
+{
+  {
+    0xe220a8397b1dcdafULL, 0x6e789e6aa1b965f4ULL, 0x06c45d188009454fULL, 0xf88bb8a8724c81ecULL,
+    0x1b39896a51a8749bULL, 0x53cb9f0c747ea2eaULL, 0x2c829abe1f4532e1ULL, 0xc584133ac916ab3cULL,
+    0x3ee5789041c98ac3ULL, 0xf3b8488c368cb0a6ULL, 0x657eecdd3cb13d09ULL, 0xc2d326e0055bdef6ULL,
+    0x8621a03fe0bbdb7bULL, 0x8e1f7555983aa92fULL, 0xb54e0f1600cc4d19ULL, 0x84bb3f97971d80abULL,
+    0x7d29825c75521255ULL, 0xc3cf17102b7f7f86ULL, 0x3466e9a083914f64ULL, 0xd81a8d2b5a4485acULL,
+    0xdb01602b100b9ed7ULL, 0xa9038a921825f10dULL, 0xedf5f1d90dca2f6aULL, 0x54496ad67bd2634cULL,
+    0xdd7c01d4f5407269ULL, 0x935e82f1db4c4f7bULL, 0x69b82ebc92233300ULL, 0x40d29eb57de1d510ULL,
+    0xa2f09dabb45c6316ULL, 0xee521d7a0f4d3872ULL, 0xf16952ee72f3454fULL, 0x377d35dea8e40225ULL,
+    0x0c7de8064963bab0ULL, 0x05582d37111ac529ULL, 0xd254741f599dc6f7ULL, 0x69630f7593d108c3ULL,
+    0x417ef96181daa383ULL, 0x3c3c41a3b43343a1ULL, 0x6e19905dcbe531dfULL, 0x4fa9fa7324851729ULL,
+    0x84eb4454a792922aULL, 0x134f7096918175ceULL, 0x07dc930b302278a8ULL, 0x12c015a97019e937ULL,
+    0xcc06c31652ebf438ULL, 0xecee65630a691e37ULL, 0x3e84ecb1763e79adULL, 0x690ed476743aae49ULL,
+    0x774615d7b1a1f2e1ULL, 0x22b353f04f4f52daULL, 0xe3ddd86ba71a5eb1ULL, 0xdf268adeb6513356ULL,
+    0x2098eb73d4367d77ULL, 0x03d6845323ce3c71ULL, 0xc952c5620043c714ULL, 0x9b196bca844f1705ULL,
+    0x30260345dd9e0ec1ULL, 0xcf448a5882bb9698ULL, 0xf4a578dccbc87656ULL, 0xbfdeaed9a17b3c8fULL,
+    0xed79402d1d5c5d7bULL, 0x55f070ab1cbbf170ULL, 0x3e00a34929a88f1dULL, 0xe255b237b8bb18fbULL
+  },
+  {
+    0x2a7b67af6c6ad50eULL, 0x466d5e7f3e46f143ULL, 0x42375cb399a4fc72ULL, 0x8c8a1f148a8bb259ULL,
+    0x32fcab5daed5bdfcULL, 0x9e60398c8d8553c0ULL, 0xee89cceb8c4064c0ULL, 0xdb0215941d86a66fULL,
+    0x5ccde78203c367a8ULL, 0xf1bcbc6a1ec11786ULL, 0xef054fceee954551ULL, 0xdf82012d0555c6dfULL,
+    0x292566ff72403c08ULL, 0xc4dd302a1bfa1137ULL, 0xd85f219db5c554e1ULL, 0x6a27ff807441bcd2ULL,
+    0x96a573e9b48216e8ULL, 0x46a9fdac40bf0048ULL, 0x3dd12464a0ee15b4ULL, 0x451e521296a7eea1ULL,
+    0x56e4398a98f8a0fdULL, 0x7b7dc2160e3335a7ULL, 0xc679ee0bebcb1ccaULL, 0x928d6f2d7453424eULL,
+    0x1b38994205234c6dULL, 0x8086d193a6f2b568ULL, 0x21c6e26639ac2c65ULL, 0xd9dccac414d23c6fULL,
+    0x91cd642057e00235ULL, 0x77fc607dc6589373ULL, 0x05b8abe26dd3aee7ULL, 0x12f6436ac376cc66ULL,
+    0x64952424897b2307ULL, 0xee8c2baf6343e5c3ULL, 0xdc4c613d9eba2304ULL, 0x3505b7796bd1a506ULL,
+    0x8176daf800a05f50ULL, 0x8bd8ff7a0385cdbcULL, 0x1a764a3cd78101daULL, 0xbe4d15bf6ca266acULL,
+    0xa85e1f38bb2dc749ULL, 0x56759a968493cd8cULL, 0xf3a9bce7336bd182ULL, 0x365b15013741519bULL,
+    0x1f7a44a6b109ac94ULL, 0x3521d628813cb177ULL, 0x6a77afab0f7c9370ULL, 0x179642d8cde95015ULL,
+    0x5ef102a8fb354461ULL, 0xf51c504764ed82f2ULL, 0xc58427f041ce6808ULL, 0xfad8fc45c9643c37ULL,
+    0xcf8682f9a70fa9c0ULL, 0x7e1b3b75a4005729ULL, 0x992dd867927b52d8ULL, 0x7fbd5db142f6791fULL,
+    0x370595aacab4adaeULL, 0xb1392dbdc5ab61d6ULL, 0x9fea7dfc79d452d9ULL, 0x40b12b120085641cULL,
+    0xa192afe3157c85d0ULL, 0xc847729f4e08f3a3ULL, 0x6f1384a306c41fc2ULL, 0x12d05c4045a39c19ULL
+  },
+  {
+    0x9899202fd20f0841ULL, 0xe9c7191857e774b8ULL, 0x4eead809af5b0cc3ULL, 0xe809acafa23864a4ULL,
+    0x4da1edaba1d0f7bdULL, 0x846eb9673349f8e4ULL, 0x87bae55b86039fe8ULL, 0x7f367b8bd953eff2ULL,
+    0x3884700f650d04e1ULL, 0xbfe4b2ab46980cadULL, 0xc5fc89075299106cULL, 0x37b2fa361adea7cdULL,
+    0x7d75d813f04895b4ULL, 0x702f5b393f62c0e0ULL, 0x0a3fc775f4ecf37fULL, 0xe4b23787a352437fULL,
+    0xf83fa245c34d6363ULL, 0xb99bcf040786cf50ULL, 0x38b6ea0a0e6c9d8aULL, 0x093fdc76776e37e1ULL,
+    0x1a75e6f76ba7eee8ULL, 0x442cdcfee9660c62ULL, 0x22d58d35116b5e0bULL, 0x87d4a5180f6a3645ULL,
+    0x589fb216bd82131bULL, 0x91d031cad319aec0ULL, 0xabecf76a553d320bULL, 0xb8686cb347612dcfULL,
+    0xfcab66337c0a77f5ULL, 0xac318214381ec437ULL, 0x6eb7f0fca24494aeULL, 0xcf42861dcdc895a9ULL,
+    0x4abad7a1586d7a91ULL, 0xc21b318dc2f49745ULL, 0xd49474dc2acbd1f0ULL, 0xb1d4873747c1c8e1ULL,
+    0x5434dc8c7d015bf6ULL, 0xe1c486287511b6a9ULL, 0xa8616df62e89a193ULL, 0x31ce6319498d8347ULL,
+    0xafd0b486123d6faaULL, 0xe6495f5d102301ebULL, 0x0dc51ced17a43c52ULL, 0x8bcbcde81355ef2dULL,
+    0x2412af73fdee7cfcULL, 0xc8d589e486e29eedULL, 0x23390e8664517f89ULL, 0x251ade58e8a6849dULL,
+    0xf8555dbd2e8f9cb0ULL, 0xcb417c3eef54f7c3ULL, 0x8028f8e1aac3a919ULL, 0x10e31052acf748a0ULL,
+    0x2d886c073b1e1b78ULL, 0x972974d90df9faeeULL, 0xbc1b7b38796893baULL, 0x1958ed432070e652ULL,
+    0xca5f297197a12dccULL, 0xe025a27375704f28ULL, 0x418010a570a924fbULL, 0x9828e2941bfc419cULL,
+    0x4fbacd2f52b85c1fULL, 0x33dd5b756211cc67ULL, 0x23c8dfdd1db57ff0ULL, 0x32f81801a1a8e901ULL
+  },
+  {
+    0x26884eac5ada36daULL, 0xcaa82f9bb42e37d4ULL, 0x19fb1a7491d6a7d1ULL, 0x5aa0243aa357f38eULL,
+    0xb31d917809e447f0ULL, 0x3f9c197225215be0ULL, 0xdc3c315a1e33c095ULL, 0x3dd399ad533e80acULL,
+    0x566f32cce8301d95ULL, 0xc880188083d9ba21ULL, 0xb9cc357f3b0e7d2eULL, 0x0237d2123a8a8d6cULL,
+    0xbf636e9aa7cbf6bdULL, 0xd7bd4284c4e2a6a7ULL, 0xda2ebb47d50577a9ULL, 0x90ba1c11b539087dULL,
+    0x44993d31552b4f57ULL, 0x32c2d6f80a8a8898ULL, 0x450583ed7fb54b19ULL, 0xec2b0b09e50ef3efULL,
+    0xd918a0b6e2efd65cULL, 0xe37a868d9785f572ULL, 0x7d1a6118f2b0f37aULL, 0x9e2e3cc13b343439ULL,
+    0xefd82c11212e37e8ULL, 0xaf89c05cd4fc75edULL, 0x55bc16bb9697108eULL, 0x6c4701fa5db69beeULL,
+    0x9237338441daf445ULL, 0x248cf0831e81a5fcULL, 0xacc13557e77de273ULL, 0x520970c25e06513aULL,
+    0x657329cb02987cabULL, 0xa9b0b3366a4e55a8ULL, 0xc4d06ca2f39acdd4ULL, 0x5dce37d68170cde1ULL,
+    0x5f1e44e77e1854c9ULL, 0x6883d452d55df899ULL, 0x05c5bd62f1067032ULL, 0xe680b683ce60fab0ULL,
+    0x5dc9da3f286d18b1ULL, 0x94b4bf3ab85ed6d8ULL, 0xce65f449e3acc5a3ULL, 0x34b0209642cea639ULL,
+    0xc14c3c771d904827ULL, 0x6addcee2bd9cdee5ULL, 0xe24eed137ffbb613ULL, 0x75dd58ef79963d1bULL,
+    0xfdb83ecf6cc24920ULL, 0x7a1d0057c57169fbULL, 0x339200f4feb62d07ULL, 0xd33f4d4ac88469f4ULL,
+    0x8226f234e68dfee4ULL, 0x320def4f2a105536ULL, 0x7786f3b13aefc159ULL, 0xb28225ac9df63ee2ULL,
+    0x781b9d0376cc6044ULL, 0x05bd0115226c6ab6ULL, 0xd302230207bdfdabULL, 0xdb898abd8e0d2933ULL,
+    0x9e79a397ba00b9ccULL, 0x89df84a5f0003ee8ULL, 0x011f04f2a75fb9beULL, 0x5a5832bb47bcf19eULL
+  },
+  {
+    0xcbdc6d34b7c7534dULL, 0x28a0d62b36f7e211ULL, 0x56c4553d5d0b9393ULL, 0x6926f3234c55dbf2ULL,
+    0x13fd156d281831abULL, 0x788fde493e59653dULL, 0x984456f3129d0de5ULL, 0x75fef0b6764f4cbaULL,
+    0x3d1500b0edf98a29ULL, 0xa149d1519fd97dc4ULL, 0x1288259c4a188588ULL, 0x304014a30b42d718ULL,
+    0x7e9d7e05138f2863ULL, 0x8379ec73f35176f4ULL, 0x72076caedab9cd77ULL, 0x933d40d047d5c211ULL,
+    0x521d6aec56c0137bULL, 0x4972307f6da2e896ULL, 0x6381fc65071e876dULL, 0xe5eba2b5b975969aULL,
+    0xf9819878b6052e93ULL, 0x42cab1f6274738afULL, 0xe8e4342ae5cfb767ULL, 0x6eb46bd2bd74a766ULL,
+    0x4dca29b4fd8880c0ULL, 0xf5de3740c3cb338dULL, 0x7c0dddf3352b6dbdULL, 0xa6208f121e7b9d80ULL,
+    0x22bb0c2a84214635ULL, 0x0f721606cabc211eULL, 0xa434826569f1a127ULL, 0x07c801c0f8fe99e7ULL,
+    0x77335155fdf6900bULL, 0x7de131ff132472a9ULL, 0x9614024d783ce84fULL, 0x0807e7c5ec9c7b14ULL,
+    0x0c5857e188e1c693ULL, 0x3c6250408655f23dULL, 0x1d94501ac76ca8cfULL, 0xa75002a693f4354aULL,
+    0x4bf2d03583341074ULL, 0xcec9908f230b6711ULL, 0xfc001b32f9982685ULL, 0xa837b30638cacfb2ULL,
+    0xdaa5f80fe9d0f70dULL, 0x45ab1a6a22d6bc17ULL, 0x476cf802330034e5ULL, 0x08b65c623f08199dULL,
+    0x619957d95328ea3cULL, 0xad6fed10cbda8dcdULL, 0xedb0d0d28761fcc0ULL, 0x23a06397a6335d81ULL,
+    0x2649be21534f387fULL, 0x6bad9f5f9193499bULL, 0x71cce7c3593342d9ULL, 0xd6f316c5c285c4deULL,
+    0xb73a83eeec718640ULL, 0x2804d8c04de3388bULL, 0xd9da1024dc5ea567ULL, 0xf47ec04292326b23ULL,
+    0xa6b94cf241e7e821ULL, 0x0c1dee5409bc203fULL, 0x33ba05bc3ee276faULL, 0x032cd31b757b30bbULL
+  },
+  {
+    0x3ccd39a590b78295ULL, 0x4a264b709d0105efULL, 0x1fa19cfc9778db71ULL, 0x8436631985e92e8bULL,
+    0x5d34de04733d0a15ULL, 0x2b181597907baf2eULL, 0xcece4d103307428bULL, 0x63a90e6c8f8391c2ULL,
+    0x4c47a8c4017695ecULL, 0x5fe135a23112e31bULL, 0xcbd065fd22102737ULL, 0x63fa700bfc399149ULL,
+    0xe23b1de2babad561ULL, 0x50c2dbee5d134327ULL, 0x93c051781267eff5ULL, 0x9aa83a6d8eb8abb3ULL,
+    0x2d2fe50e4473ade9ULL, 0x5fa1690e247adf55ULL, 0x62f4f57b730a8d16ULL, 0x616308740e528066ULL,
+    0x861731f13c272113ULL, 0x3c6caec2abb41615ULL, 0x58dc98d3a4b965dfULL, 0xac67e58c447a30f3ULL,
+    0x717d1b34d0f226b5ULL, 0x5068123375a5b3c6ULL, 0x65955f41cfd0e893ULL, 0x7a05e7206258c3f8ULL,
+    0x530b98a49018d298ULL, 0x4164a427d5be9ebbULL, 0x8ed388d35f43ad87ULL, 0xeda8fa6a8a59bc0eULL,
+    0xa6b3a6712afcd38aULL, 0x857b0535c58d6b14ULL, 0x35ccc2bf24fbceb1ULL, 0x91757f9b2437ce51ULL,
+    0x4f9a23e2b151be74ULL, 0x78779a725ea2d9feULL, 0xcc4ec68084cc7e95ULL, 0xb6966a6140bf3535ULL,
+    0x89de59fa33170a0aULL, 0x45891bd34267a6efULL, 0x68eb3b32aa806aacULL, 0xae2e7ecc4c8e0da9ULL,
+    0x9c6973b1cd7c1a97ULL, 0xb2a774c1f3488fb5ULL, 0x00bb92e27d083dcaULL, 0x5d9f2c93ff73a7a1ULL,
+    0xf77effea672d02c9ULL, 0x2c8f635e04e16818ULL, 0x63ccdda60ab7b0a9ULL, 0x1cce0bba630053b2ULL,
+    0xeabd508b9df52a49ULL, 0x85232b4a312d42a2ULL, 0x907271a5478cde49ULL, 0x5a63530cfad0b243ULL,
+    0xab1a732b3f586b99ULL, 0xadeae4869d4467b3ULL, 0x2a4176cc70fa8c52ULL, 0x871ed802e15cf126ULL,
+    0x41a665fe26a7a248ULL, 0xe6855668819e63a0ULL, 0x7946342a93638d09ULL, 0xcee7f6ce76c24791ULL
+  },
+  {
+    0x90746e60ef10929cULL, 0x303f222ec15a3656ULL, 0x91ca8850bdb392a5ULL, 0x282be21753fd8812ULL,
+    0x8da4658f613ba6a7ULL, 0x39f0f2e09ba26805ULL, 0xe10e043370f4ce5fULL, 0xe3ef8013856fc40cULL,
+    0x10155b096e22e7f7ULL, 0xb06fa4f0d3afe2d3ULL, 0x98dabb1c64aa2138ULL, 0x662426bd0482cb44ULL,
+    0xd49604a4e3af5c6aULL, 0x1d73b2634c39403eULL, 0x894fb150a04be81cULL, 0x2a2e37a33a8f339dULL,
+    0x412b63228c0d97d9ULL, 0xe4534eb1558ea880ULL, 0x22d471edcc01f620ULL, 0x1810596a0c2284f9ULL,
+    0x55ea875e6ee39c26ULL, 0xfda91f81674f3233ULL, 0x99fb91542b2ef76cULL, 0x4850117266c0d41fULL,
+    0x4c84fdeeb5b71336ULL, 0x5b65923ac30ec1f4ULL, 0x001fce785e79eaccULL, 0xe7035aadba840af9ULL,
+    0xef062cfb5d3a3fa4ULL, 0x91cf003dc64d2047ULL, 0x6a6bbae4c69f0558ULL, 0xbc83ebe6cd2818d8ULL,
+    0xc3a32910d5aeaa2dULL, 0x2f124b01d8c37ff7ULL, 0x89908fb20936c74fULL, 0x30307ace765d040bULL,
+    0x2efc3e93492e7d12ULL, 0xb5af6d95d72949eaULL, 0x9217fa5ec037abe8ULL, 0xa27ca1090743f1bdULL,
+    0x9e58d128e268bc60ULL, 0x331f5ff8d2f1cccaULL, 0x1318b39f628757d7ULL, 0xf1eedce334401c5eULL,
+    0x10448c3a57ddd877ULL, 0xc6220951fb35d453ULL, 0xa492fa1749559626ULL, 0xc16c742d1cc888f8ULL,
+    0x4ee6be96e6483c3bULL, 0xd8c4cbbb86af34bdULL, 0xc23fe6e086e66126ULL, 0x593573115d89d57dULL,
+    0xeae4b6ca31a0b512ULL, 0x1303e0c57b6e8645ULL, 0xa7ce5911a9cb5e60ULL, 0xac52a06a93326442ULL,
+    0x1cfa401114d214feULL, 0x657c7edd5a6a2d11ULL, 0x74f7dfc8ad75e5beULL, 0xb93bd966433a5eb5ULL,
+    0x395abf3428c5ef4dULL, 0x3a7c844c5ed8c333ULL, 0xc6a32156c0e52c52ULL, 0x811e01f4016f91f7ULL
+  },
+  {
+    0x5fd205755dc324cfULL, 0x8b8e6cb9d7a25c5eULL, 0x6a393c91b09a4f24ULL, 0x2419d24941d2879eULL,
+    0xcb11d3d322378c3fULL, 0x89a0d947e7359ba9ULL, 0x9ac235af1b306ee2ULL, 0xdb17fbea36289ad2ULL,
+    0x5ede9c17dedafd6bULL, 0xef0cd7b4e4ec0de6ULL, 0xa4b32cc50529ec8aULL, 0x3729e60466e76c72ULL,
+    0xbc1b968695dfd347ULL, 0x1208879d7d4bde63ULL, 0x8eccc08b8c8ddefaULL, 0x61d1b6bfda572c2dULL,
+    0x2e5bfe8ae0bfc011ULL, 0xbb93b47e50da3162ULL, 0x4dc253ba47fe4964ULL, 0x214619698f00fb1aULL,
+    0x7065de8fd6721979ULL, 0x319c324c72c708c9ULL, 0x5ef5bbc18466cf1dULL, 0xf1cae3b64977eec5ULL,
+    0x6ff929d26a842420ULL, 0xe8bab64cef650d0eULL, 0xa0fff83df2901695ULL, 0xd0ae24de4223d192ULL,
+    0xbc60367453eec23fULL, 0x6d8046b801afbc9dULL, 0x26018251926c0991ULL, 0x1a68be3a035b5707ULL,
+    0x242ae4893b70b22eULL, 0xb99c78cbc599a070ULL, 0xed8916b381e9a6e2ULL, 0x37695a55e05cd381ULL,
+    0x5c6c9c4ed6632ee1ULL, 0xcd463f48a9a8274eULL, 0x24e864649fafa6c7ULL, 0xba69a8bac9998133ULL,
+    0x292bb3d3fb84ffd6ULL, 0x32fbf0c6bd46a684ULL, 0xffa0d42a285685ceULL, 0xf8ec28585e907988ULL,
+    0x955d78582b84939bULL, 0x7a8e5ece174ec569ULL, 0x0bde70207d0f01f9ULL, 0xf9d49516f6bcd773ULL,
+    0x5ca61d38ace08deaULL, 0x73acebd3d49d7857ULL, 0xf4721387d67a23c1ULL, 0x400830fb417eed4fULL,
+    0x43613db3f0b2e10dULL, 0x0c2683675b3e7196ULL, 0x0f0a3c18070a38e0ULL, 0x00fba4231f3fd447ULL,
+    0x4a83615e584ea5bbULL, 0xd1c390e9829e2e7dULL, 0x62c7bae420fe77b5ULL, 0xca9b275e0cfacc12ULL,
+    0x6e0bb5df568d5670ULL, 0x47b0f2e81ea86cf0ULL, 0x6b4b89c9cc0875b7ULL, 0x4980af326a4b65d8ULL
+  },
+  {
+    0x83fcc71fa8833aa3ULL, 0x327eee6ec9598964ULL, 0x04dfae11b8dcf861ULL, 0x4c3433717af5c89aULL,
+    0x22b7ba9e68349351ULL, 0x47666d1b6fcaa9e7ULL, 0x556e1ab391b34d79ULL, 0xa6a3245dd1c3fe53ULL,
+    0xa8241f6fae45b8d5ULL, 0xc1d7ed7b9c6bec16ULL, 0x9fc26e2d14919f22ULL, 0x4fc2ccc9159d054fULL,
+    0x4a6881df0c028b9bULL, 0x45a577f1bab58960ULL, 0xa1bdb57c6ca2dbc1ULL, 0xebfde16cec9e9974ULL,
+    0x4e7911ddbed4fc71ULL, 0x71e606409319727bULL, 0xdc0d879ed0bbe640ULL, 0x4293a2a13fb2fb89ULL,
+    0xaf24d14180037e79ULL, 0x53be5793563e006cULL, 0x157786cbc486d2a0ULL, 0xb0752c30eaa58544ULL,
+    0xbb61ee342e9a8210ULL, 0x635d396b1bd1da07ULL, 0x4d7c14a84bc6fdb5ULL, 0x613a9c99235d15beULL,
+    0xfb7c05e13c1703fcULL, 0x3f7d3faa5694d6aeULL, 0x21dc527f0ab4ab9bULL, 0x0251b77b538e03fcULL,
+    0x802e57a14bf8215dULL, 0x51ec9407992ac5b8ULL, 0x48a69543e5dc1734ULL, 0x22abaa84fd19e270ULL,
+    0x8f34cbb275b951ecULL, 0xdf92f91b1cb7a033ULL, 0x157f0e4ccdb056a8ULL, 0xd889bab710a7570eULL,
+    0xe180887a35c9acd9ULL, 0x16c94ed584523d02ULL, 0x3cb6b899028ba353ULL, 0xade4153860320f39ULL,
+    0x62a15d96596742b3ULL, 0xc24e3101c5ab7a66ULL, 0xd2f48e99a11767a6ULL, 0x1542a77e8df4cc9fULL,
+    0x70450553f57c306fULL, 0x6596e4bb0ab6fe55ULL, 0xb31ad51edb07e16dULL, 0x14f8ec0b2dd720c3ULL,
+    0x66623fbeb6a18744ULL, 0xbac8a59c8fc9f445ULL, 0x0134cf3de391eae9ULL, 0x3934dcea8dd8e425ULL,
+    0x50621c6ebfc34e9bULL, 0xa0d5ee425797481aULL, 0xe65f9512ff9a97f3ULL, 0x12a9fea1d634c54eULL,
+    0x043aab402beaaba8ULL, 0x3fbaaa86d4844270ULL, 0xe179606eaa9381e4ULL, 0x54238caebf32828cULL
+  },
+  {
+    0x6e3b64d7f5c88d2bULL, 0x685f1f2fc2e6b27aULL, 0xfd8563efde1f4398ULL, 0x4423c5046aa5f8faULL,
+    0x6bcf56187d539753ULL, 0xd03a3b54209703fbULL, 0x251d485d8178acd6ULL, 0x3f66ca397592e07fULL,
+    0x552bdfce433cc6cbULL, 0x44addd817db8b4dfULL, 0xb000cbf3ce21b869ULL, 0xd2e9983a72149fb3ULL,
+    0xaf947e60ad892ed4ULL, 0x577451b6ef6afcbfULL, 0x78da7cb7c466fbfdULL, 0xd5e3634444e34975ULL,
+    0x344e8d54603a3643ULL, 0x0b8d292730b546d0ULL, 0x8acfe26983852bafULL, 0xf4fe6ba91c741977ULL,
+    0x86d2315d1e0dc68aULL, 0x8d9d062df69ee643ULL, 0x9ba452ec9b87acabULL, 0x60d53c599f2efcf5ULL,
+    0x05cf9a10ae33fd6eULL, 0xed86e1913867a31fULL, 0xcbf6a4ee31486382ULL, 0x5c088030503f61eaULL,
+    0x371da374bf0bbd06ULL, 0x67325e50cebaafc4ULL, 0x40613d7fabc27df7ULL, 0x873450e33f8ec632ULL,
+    0xc87c2173dd433a8dULL, 0xa337defd2fa45812ULL, 0xc6d6572f9c4db5f7ULL, 0x43df2a2bb9dc1f8eULL,
+    0xa949f99ae4579ae7ULL, 0x2ce95f8710af973eULL, 0x9b6f7d1586d5c2a8ULL, 0x1591bcac785b49b3ULL,
+    0xefe019ea91a1cdb3ULL, 0x0f308d530055c460ULL, 0x549cbb2ebe9b6412ULL, 0xe45cd3103ac8afb2ULL,
+    0x8956d2c6a1c2a173ULL, 0x3c6a03f08df43ecaULL, 0x515e34df346c7f59ULL, 0xdb1b56d7efbf053cULL,
+    0xad13006e7260fc0fULL, 0x9aa291b6d59d39dfULL, 0x3a91dfda8521dd07ULL, 0x30e27d3a3f4ad189ULL,
+    0x1b7cd23c60e3768eULL, 0x1e65dbab69f02d4fULL, 0x647b114c433bbaa5ULL, 0x7dcdca42f34b7db1ULL,
+    0xc9bc4616c0261cf4ULL, 0xbb980258f543d9bdULL, 0xd0867d4a79935127ULL, 0x7faa29c4257de927ULL,
+    0x7c47efc4dc9daeb3ULL, 0xfc4455323ed6a688ULL, 0xa6c803ab2fc31dc5ULL, 0xfe3316e8a126c648ULL
+  },
+  {
+    0x0e4d6fee8331db63ULL, 0x748cfa660c95016aULL, 0xb2747dbf2bc34adfULL, 0xfa6ed441e6468e9eULL,
+    0xae42190933ffc09aULL, 0xff9c92fd3654a582ULL, 0xd33fcd8cd9e61ac5ULL, 0x371ad28c40094647ULL,
+    0x5d9dc02bb2d14812ULL, 0xaa7bf2b3524699c7ULL, 0x4cb261d764240af1ULL, 0xeb0074eb49c8f038ULL,
+    0x2235c793c6b2ec94ULL, 0x326ce3de14b10487ULL, 0x7d26c935d601635cULL, 0xfb023c83c005f89bULL,
+    0x7a7abfe47cf11a74ULL, 0x326d14295729a098ULL, 0x4051c8e5a0e36e25ULL, 0xad5fb3df4788ab9bULL,
+    0xa06e91e446927881ULL, 0x24765f3e77532660ULL, 0x4ba5bdc5384f18c4ULL, 0xc7f4e017f8732292ULL,
+    0x6e992a983b7edde2ULL, 0x8e833aefb26a1864ULL, 0x1ba3adee92f08807ULL, 0xd033c438ac3973adULL,
+    0x109596208f6b9577ULL, 0xc15e6593e972512aULL, 0xcac8e49bb608b4daULL, 0x8d2dda6d5c05dbe7ULL,
+    0x61059bbb11e53600ULL, 0x890dd6765d924d3bULL, 0x326a9a09a42a8f64ULL, 0xba22ce1e7d55ac2eULL,
+    0x6e3070eca2371016ULL, 0x4e6545c9f7372bbfULL, 0x44285c955996db95ULL, 0xc2c610e81ca500cdULL,
+    0x6a2cf7bbc4f311bdULL, 0xfc4b27eaf1ce13b0ULL, 0xb82b569d4298bdeaULL, 0x73cbe4a05d9c604aULL,
+    0x0d0608d17a2f7994ULL, 0xcf7e1d758bc7f5b5ULL, 0x449c532e01903840ULL, 0x109385b3578bc434ULL,
+    0x5b0d87c9fca26014ULL, 0x491c73c8f628c62aULL, 0x3079ee10edbe7ba1ULL, 0x0cff6b3d3e6c15b8ULL,
+    0x1d6b458f2c076c70ULL, 0xc61d459c911f3537ULL, 0xda68adbdc675be53ULL, 0x8de990e037753ab0ULL,
+    0xa6092d6f9f9e0b84ULL, 0x5b3b3a90aa6ac400ULL, 0x66598cc7b6406583ULL, 0x1ca70aee97a1b837ULL,
+    0xaf82a4ce58ef93b7ULL, 0xc7ce4b9b13282484ULL, 0x2b889662669711b0ULL, 0x994f1f541e8ec4b1ULL
+  },
+  {
+    0xa04691fbe4451815ULL, 0xe7450f8101bd21d5ULL, 0xaa94a8216c7141a7ULL, 0x06316d1c8dd41b5cULL,
+    0xfe600c367a8aa52bULL, 0x0577481e942a07a3ULL, 0x1a3704f86eefde92ULL, 0x1ddd864f1b50782bULL,
+    0x4e6e17f5f3b362dbULL, 0x36c4e9881a205ff0ULL, 0x87615288d5788a80ULL, 0xf0ef34e4bd45b3fcULL,
+    0x1bc57badac418d9eULL, 0x9fc338c00035d21bULL, 0x17dda7edf8cea21bULL, 0x9bdae11a59ed17e3ULL,
+    0x9aeb37281961af39ULL, 0x426ac051d05d0541ULL, 0x1f6bf9fcbd650853ULL, 0xb6b485c32054d2dbULL,
+    0x33cd737c1bd48bbcULL, 0xbf7d815f20c6aa90ULL, 0xbddcaa250dae14baULL, 0xeadf33672f2eef00ULL,
+    0x1dfcf9099f404e93ULL, 0x9322250b5159a644ULL, 0xf317f503a92d62bfULL, 0xc81c284dd319fe2fULL,
+    0x6c99b2aac29b7da3ULL, 0x09654e59fe299319ULL, 0x7fac22d4a36c1cdbULL, 0x031c79fc0e5d0ba8ULL,
+    0x6786f2a8b25df1e6ULL, 0xc5d9b45dc06a2973ULL, 0x494c1be2f16aa7e5ULL, 0xcd6572b288330281ULL,
+    0x1fec2ad7e539e591ULL, 0x70ff92eac7d644ebULL, 0xa23a58e2a5158332ULL, 0x8097046c8febebb5ULL,
+    0xf48ef92917693662ULL, 0xc768ecaf06040013ULL, 0x64da73f83a1654d7ULL, 0x4653bf0aa21d2e83ULL,
+    0x89ceaa06806a3ab2ULL, 0x11266d2e4dc768e4ULL, 0x72e16539c447b502ULL, 0xfa65940fded7d4c1ULL,
+    0x4d12ed9b2035457cULL, 0xe945d4cb35ed57edULL, 0x75d44c13bffb0f19ULL, 0xf690c8970c88d47aULL,
+    0xe1ae0e7fc137e303ULL, 0x5ce6c3417289b541ULL, 0xd71c344eab53f9bfULL, 0xac337044a96df7afULL,
+    0xafe25963a3014e07ULL, 0x5b92f7a78b315407ULL, 0x120a9962ff1fa138ULL, 0xbec62925bc2c2731ULL,
+    0x840784564071255bULL, 0xb96ac0ee3219851fULL, 0x2b686d2aaf437b55ULL, 0x862caf81e41a1a19ULL
+  },
+  {
+    0x1c787a8631a3cc4cULL, 0xada2b6b30a0fbd78ULL, 0xe9bff1ac37cd3760ULL, 0x5b1c44f240a786dfULL,
+    0xdd2e5d6f2b4b30d5ULL, 0x74cdd16b7f0fb3c4ULL, 0x39edba15ba6d5deaULL, 0x893a48adc5c59fc3ULL,
+    0x5d88d67ac62f910aULL, 0x6637c1ce6357a2c8ULL, 0xfc7b432fba88a23cULL, 0xcbd18ebcd1f9b00dULL,
+    0xcc5d77cdfdf2f139ULL, 0x0f87eec1b08afc93ULL, 0xdad6d0b2edb856a9ULL, 0xf1967332fb44fe31ULL,
+    0x7e2ea1f8378a6b05ULL, 0xf7030484c2112723ULL, 0xc9270af5de5dd831ULL, 0x17b0c92492db0be6ULL,
+    0x65ef9855875761f5ULL, 0xf70f6fc08fbc6cd2ULL, 0x31a80f56d1763c8bULL, 0x719544336229e7d2ULL,
+    0x297d5f1702685620ULL, 0xfecaaf16b0750091ULL, 0x4e48827cf8c61f54ULL, 0x041cbea18af9baecULL,
+    0xbfc582141f1f8448ULL, 0x1f2db364484c8c42ULL, 0xb156cd02f199bf01ULL, 0x805880df9cd1f3efULL,
+    0xf1de0875b332446fULL, 0x81487f13496e7b8aULL, 0xa1c603e2d2b1c755ULL, 0xb5be0c9a1bb00e12ULL,
+    0x982fad98f4955b0bULL, 0x6f71eec14e3c2891ULL, 0xd61f8c52a46143c3ULL, 0x9be3190d6b9b942eULL,
+    0x6e8e1898868eb0a2ULL, 0x553f7f84144a4c23ULL, 0x228fd26aaba0c661ULL, 0x98ec5ef763a53fcfULL,
+    0xa6ae40dddfd3d2f3ULL, 0x1a9f21e6e88f29c1ULL, 0x7abf2e6dbc13d977ULL, 0xbf4e2f41816ea15eULL,
+    0x3ff81d2834cb6d60ULL, 0xa8f148af30f4b908ULL, 0xd6e2f0e513d0d43eULL, 0xb1bdab8e9dc78bf4ULL,
+    0x219142e8b65466f4ULL, 0x003f9cf0bcf3d599ULL, 0x4615e70816e98019ULL, 0x533b11bf7e56aad2ULL,
+    0x0c5d654dedaa707aULL, 0x72dca3b0fc2499edULL, 0x8b733297980fe1b3ULL, 0x999051b19bfb8a9dULL,
+    0xdd0253a971577375ULL, 0x69a7bf83e48e8c0dULL, 0xd7a6ad2b2561d503ULL, 0x7907d7cf9a5031b0ULL
+  }
+};
+
+const u64 SideKey = 0x84ed151ff847e34aULL;
+
+const u64 CastleKeys[CASTLE_SIZE] =
+{
+  0x15be59597232432cULL, 0xfbe3ff25e49e4f60ULL, 0x5e249603b186ffeeULL, 0x8507c98608ea78c6ULL,
+  0x9195b6d500d6ae15ULL, 0xfec636268e3c8614ULL, 0x08ada769154f454bULL, 0xc2500e05c8d70685ULL,
+  0x58eb04418d0b1ad1ULL, 0xc97791448b561151ULL, 0x6c85ac83841a3e00ULL, 0x9d47ceec316ed9a1ULL,
+  0x52de011a7eddd2acULL, 0xbc4b86a9c00b5e45ULL, 0xded704b13adb6e3bULL, 0x4329a1e75142a10eULL
+};
 
 // Characters
 const char PieceCharacters[] = ".PNBRQKpnbrqk";
@@ -43,6 +359,7 @@ const int BigPieces[PIECE_SIZE] = { FALSE, FALSE, TRUE, TRUE, TRUE, TRUE, TRUE,
 const int MajorPieces[PIECE_SIZE] = { FALSE, FALSE, FALSE, FALSE, TRUE, TRUE, TRUE, FALSE, FALSE, FALSE, TRUE, TRUE, TRUE };
 const int MinorPieces[PIECE_SIZE] = { FALSE, FALSE, TRUE, TRUE, FALSE, FALSE, FALSE, FALSE, TRUE, TRUE, FALSE, FALSE, FALSE };
 const int PieceValues[PIECE_SIZE] = { 0, 100, 325, 325, 550, 1000, 50000, 100, 325, 325, 550, 1000, 50000 };
+const int VictimScores[PIECE_SIZE] = { 0, 100, 200, 300, 400, 500, 600, 100, 200, 300, 400, 500, 600 };
 const int PieceColors[PIECE_SIZE] = { FALSE, WHITE, WHITE, WHITE, WHITE, WHITE, WHITE, BLACK, BLACK, BLACK, BLACK, BLACK, BLACK };
 
 const int KnightPieces[PIECE_SIZE] = { FALSE, FALSE, TRUE, FALSE, FALSE, FALSE, FALSE, FALSE, TRUE, FALSE, FALSE, FALSE, FALSE };
@@ -81,6 +398,213 @@ const int NonSlidePieceIterator[6] = { WHITE_KNIGHT, WHITE_KING, EMPTY, BLACK_KN
 int LoopSlideIndex[2] = { 0, 4 };
 int LoopNonSlideIndex[2] = { 0, 3 };
 
+// Most valuable victim, least valuable attacker capture scores
+int MvvLvaScores[PIECE_SIZE][PIECE_SIZE];
+
+// Piece-square tables for white from rank 8 down to rank 1, by piece type
+const int MiddlegameTables[WHITE_KING + 1][INDEX_SIZE] = {
+  {
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+  },
+  {
+      0,   0,   0,   0,   0,   0,   0,   0,
+     98, 134,  61,  95,  68, 126,  34, -11,
+     -6,   7,  26,  31,  65,  56,  25, -20,
+    -14,  13,   6,  21,  23,  12,  17, -23,
+    -27,  -2,  -5,  12,  17,   6,  10, -25,
+    -26,  -4,  -4, -10,   3,   3,  33, -12,
+    -35,  -1, -20, -23, -15,  24,  38, -22,
+      0,   0,   0,   0,   0,   0,   0,   0,
+  },
+  {
+   -167, -89, -34, -49,  61, -97, -15,-107,
+    -73, -41,  72,  36,  23,  62,   7, -17,
+    -47,  60,  37,  65,  84, 129,  73,  44,
+     -9,  17,  19,  53,  37,  69,  18,  22,
+    -13,   4,  16,  13,  28,  19,  21,  -8,
+    -23,  -9,  12,  10,  19,  17,  25, -16,
+    -29, -53, -12,  -3,  -1,  18, -14, -19,
+   -105, -21, -58, -33, -17, -28, -19, -23,
+  },
+  {
+    -29,   4, -82, -37, -25, -42,   7,  -8,
+    -26,  16, -18, -13,  30,  59,  18, -47,
+    -16,  37,  43,  40,  35,  50,  37,  -2,
+     -4,   5,  19,  50,  37,  37,   7,  -2,
+     -6,  13,  13,  26,  34,  12,  10,   4,
+      0,  15,  15,  15,  14,  27,  18,  10,
+      4,  15,  16,   0,   7,  21,  33,   1,
+    -33,  -3, -14, -21, -13, -12, -39, -21,
+  },
+  {
+     32,  42,  32,  51,  63,   9,  31,  43,
+     27,  32,  58,  62,  80,  67,  26,  44,
+     -5,  19,  26,  36,  17,  45,  61,  16,
+    -24, -11,   7,  26,  24,  35,  -8, -20,
+    -36, -26, -12,  -1,   9,  -7,   6, -23,
+    -45, -25, -16, -17,   3,   0,  -5, -33,
+    -44, -16, -20,  -9,  -1,  11,  -6, -71,
+    -19, -13,   1,  17,  16,   7, -37, -26,
+  },
+  {
+    -28,   0,  29,  12,  59,  44,  43,  45,
+    -24, -39,  -5,   1, -16,  57,  28,  54,
+    -13, -17,   7,   8,  29,  56,  47,  57,
+    -27, -27, -16, -16,  -1,  17,  -2,   1,
+     -9, -26,  -9, -10,  -2,  -4,   3,  -3,
+    -14,   2, -11,  -2,  -5,   2,  14,   5,
+    -35,  -8,  11,   2,   8,  15,  -3,   1,
+     -1, -18,  -9,  10, -15, -25, -31, -50,
+  },
+  {
+    -65,  23,  16, -15, -56, -34,   2,  13,
+     29,  -1, -20,  -7,  -8,  -4, -38, -29,
+     -9,  24,   2, -16, -20,   6,  22, -22,
+    -17, -20, -12, -27, -30, -25, -14, -36,
+    -49,  -1, -27, -39, -46, -44, -33, -51,
+    -14, -14, -22, -46, -44, -30, -15, -27,
+      1,   7,  -8, -64, -43, -16,   9,   8,
+    -15,  36,  12, -54,   8, -28,  24,  14,
+  },
+};
+
+const int EndgameTables[WHITE_KING + 1][INDEX_SIZE] = {
+  {
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,
+  },
+  {
+      0,   0,   0,   0,   0,   0,   0,   0,
+    178, 173, 158, 134, 147, 132, 165, 187,
+     94, 100,  85,  67,  56,  53,  82,  84,
+     32,  24,  13,   5,  -2,   4,  17,  17,
+     13,   9,  -3,  -7,  -7,  -8,   3,  -1,
+      4,   7,  -6,   1,   0,  -5,  -1,  -8,
+     13,   8,   8,  10,  13,   0,   2,  -7,
+      0,   0,   0,   0,   0,   0,   0,   0,
+  },
+  {
+    -58, -38, -13, -28, -31, -27, -63, -99,
+    -25,  -8, -25,  -2,  -9, -25, -24, -52,
+    -24, -20,  10,   9,  -1,  -9, -19, -41,
+    -17,   3,  22,  22,  22,  11,   8, -18,
+    -18,  -6,  16,  25,  16,  17,   4, -18,
+    -23,  -3,  -1,  15,  10,  -3, -20, -22,
+    -42, -20, -10,  -5,  -2, -20, -23, -44,
+    -29, -51, -23, -15, -22, -18, -50, -64,
+  },
+  {
+    -14, -21, -11,  -8,  -7,  -9, -17, -24,
+     -8,  -4,   7, -12,  -3, -13,  -4, -14,
+      2,  -8,   0,  -1,  -2,   6,   0,   4,
+     -3,   9,  12,   9,  14,  10,   3,   2,
+     -6,   3,  13,  19,   7,  10,  -3,  -9,
+    -12,  -3,   8,  10,  13,   3,  -7, -15,
+    -14, -18,  -7,  -1,   4,  -9, -15, -27,
+    -23,  -9, -23,  -5,  -9, -16,  -5, -17,
+  },
+  {
+     13,  10,  18,  15,  12,  12,   8,   5,
+     11,  13,  13,  11,  -3,   3,   8,   3,
+      7,   7,   7,   5,   4,  -3,  -5,  -3,
+      4,   3,  13,   1,   2,   1,  -1,   2,
+      3,   5,   8,   4,  -5,  -6,  -8, -11,
+     -4,   0,  -5,  -1,  -7, -12,  -8, -16,
+     -6,  -6,   0,   2,  -9,  -9, -11,  -3,
+     -9,   2,   3,  -1,  -5, -13,   4, -20,
+  },
+  {
+     -9,  22,  22,  27,  27,  19,  10,  20,
+    -17,  20,  32,  41,  58,  25,  30,   0,
+    -20,   6,   9,  49,  47,  35,  19,   9,
+      3,  22,  24,  45,  57,  40,  57,  36,
+    -18,  28,  19,  47,  31,  34,  39,  23,
+    -16, -27,  15,   6,   9,  17,  10,   5,
+    -22, -23, -30, -16, -16, -23, -36, -32,
+    -33, -28, -22, -43,  -5, -32, -20, -41,
+  },
+  {
+    -74, -35, -18, -18, -11,  15,   4, -17,
+    -12,  17,  14,  17,  17,  38,  23,  11,
+     10,  17,  23,  15,  20,  45,  44,  13,
+     -8,  22,  24,  27,  26,  33,  26,   3,
+    -18,  -4,  21,  24,  27,  23,   9, -11,
+    -19,  -3,  11,  21,  23,  16,   7,  -9,
+    -27, -11,   4,  13,  14,   4,  -5, -17,
+    -53, -34, -21, -11, -28, -14, -24, -43,
+  },
+};
+
+// Pawn structure scores for each game phase, passed pawns by relative rank
+const int PassedMiddlegame[RANK_X] = { 0, 5, 10, 15, 25, 40, 60, 0 };
+const int PassedEndgame[RANK_X] = { 0, 10, 20, 35, 60, 100, 150, 0 };
+const int IsolatedMiddlegame = -10;
+const int IsolatedEndgame = -15;
+const int DoubledMiddlegame = -10;
+const int DoubledEndgame = -20;
+const int BackwardMiddlegame = -8;
+const int BackwardEndgame = -10;
+
+// Piece values for each game phase, by piece type
+const int MiddlegameValues[WHITE_KING + 1] = { 0, 82, 337, 365, 477, 1025, 0 };
+const int EndgameValues[WHITE_KING + 1] = { 0, 94, 281, 297, 512, 936, 0 };
+
+// Piece-square scores including piece values, for each piece and index
+int MiddlegamePieceSquare[PIECE_SIZE][INDEX_SIZE];
+int EndgamePieceSquare[PIECE_SIZE][INDEX_SIZE];
+
+// HalfKP piece offsets for each perspective, with kings not being features
+const int FeaturePieceOffsets[SIDE_SIZE][PIECE_SIZE] = {
+  { 0,  1, 129, 257, 385, 513, 0, 65, 193, 321, 449, 577, 0 },
+  { 0, 65, 193, 321, 449, 577, 0,  1, 129, 257, 385, 513, 0 },
+};
+
+// Network used for evaluation once loaded
+Network Nnue;
+int NnueLoaded = FALSE;
+
+// Whether moves are taken back by restoring a snapshot instead of undoing them
+int CopyMake = FALSE;
+
+// Positions timed by the benchmark
+char *BenchPositions[] =
+{
+  FEN_INIT,
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"
+};
+
+// White king indices in the a1-d1-d4 triangle used by pawnless bitbases, and the slot of each index in it
+const int KingTriangleIndices[10] = { 0, 1, 2, 3, 9, 10, 11, 18, 19, 27 };
+int KingTriangleSlots[INDEX_SIZE];
+
+// Cuckoo table of reversible move keys, with the indices of the squares each move connects
+u64 CuckooKeys[CUCKOO_SIZE];
+int CuckooFrom[CUCKOO_SIZE];
+int CuckooTo[CUCKOO_SIZE];
+
+// Bitbases loaded for probing
+Bitbase Bitbases[MAX_BITBASES];
+int BitbaseCount = 0;
+
+// Bitbases generated and loaded when none are named
+char *DefaultBitbases[] = { "KPK", "KNK", "KBK", "KRK", "KQK", "KBNK" };
+
 // Castle permissions
 const int CastlePermissions[POSITION_SIZE] = {
   15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
@@ -127,6 +651,60 @@ char *GetStringFromPosition(int position)
   return str;
 }
 
+// Get slide attack table index from occupancy
+int GetMagicIndex(const Magic *magic, u64 occupancy)
+{
+#ifdef USE_PEXT
+  return (int)_pext_u64(occupancy, magic->mask);
+#else
+  return (int)(((occupancy & magic->mask) * magic->magic) >> magic->shift);
+#endif
+}
+
+// Get bishop attacks from index and occupancy
+u64 GetBishopAttacks(int index, u64 occupancy)
+{
+  const Magic *magic = &BishopMagicTable[index];
+  return magic->attacks[GetMagicIndex(magic, occupancy)];
+}
+
+// Get rook attacks from index and occupancy
+u64 GetRookAttacks(int index, u64 occupancy)
+{
+  const Magic *magic = &RookMagicTable[index];
+  return magic->attacks[GetMagicIndex(magic, occupancy)];
+}
+
+// Get queen attacks from index and occupancy
+u64 GetQueenAttacks(int index, u64 occupancy)
+{
+  return GetBishopAttacks(index, occupancy) | GetRookAttacks(index, occupancy);
+}
+
+// Get non-pawn piece attacks from index and occupancy
+u64 GetPieceAttacks(int piece, int index, u64 occupancy)
+{
+  u64 attacks = 0ULL;
+
+  if (KnightPieces[piece])
+  {
+    return KnightAttacks[index];
+  }
+  if (KingPieces[piece])
+  {
+    return KingAttacks[index];
+  }
+  if (BishopOrQueenPieces[piece])
+  {
+    attacks |= GetBishopAttacks(index, occupancy);
+  }
+  if (RookOrQueenPieces[piece])
+  {
+    attacks |= GetRookAttacks(index, occupancy);
+  }
+  return attacks;
+}
+
 //// Init ////
 
 // Initialize board conversion
@@ -173,20 +751,297 @@ void InitBitMask()
   }
 }
 
-// Initalize hash keys
-void InitHashKeys()
+// Initialize attack masks
+void InitAttackMask()
 {
-  for (int i = 0; i < PIECE_SIZE; ++i)
+  const int PawnAttackDirection[SIDE_SIZE][2] = { { 9, 11 }, { -9, -11 } };
+
+  for (int i = 0; i < INDEX_SIZE; ++i)
+  {
+    int position = GetPositionFromIndex(i);
+    int target = 0;
+
+    PawnAttacks[WHITE][i] = 0ULL;
+    PawnAttacks[BLACK][i] = 0ULL;
+    KnightAttacks[i] = 0ULL;
+    KingAttacks[i] = 0ULL;
+
+    // Pawns
+    for (int side = WHITE; side <= BLACK; ++side)
+    {
+      for (int j = 0; j < 2; ++j)
+      {
+        target = position + PawnAttackDirection[side][j];
+        if (PositionToIndex[target] != INDEX_SIZE)
+        {
+          PawnAttacks[side][i] |= SetMask[PositionToIndex[target]];
+        }
+      }
+    }
+
+    // Knights and kings
+    for (int j = 0; j < 8; ++j)
+    {
+      target = position + KnightAttackDirection[j];
+      if (PositionToIndex[target] != INDEX_SIZE)
+      {
+        KnightAttacks[i] |= SetMask[PositionToIndex[target]];
+      }
+
+      target = position + KingAttackDirection[j];
+      if (PositionToIndex[target] != INDEX_SIZE)
+      {
+        KingAttacks[i] |= SetMask[PositionToIndex[target]];
+      }
+    }
+  }
+}
+
+// Generate slide attack by walking the rays until blocked
+u64 GenerateSlideAttack(int position, u64 occupancy, const int *directions)
+{
+  u64 attack = 0ULL;
+
+  for (int i = 0; i < 4; ++i)
+  {
+    int target = position + directions[i];
+    while (PositionToIndex[target] != INDEX_SIZE)
+    {
+      attack |= SetMask[PositionToIndex[target]];
+      if (occupancy & SetMask[PositionToIndex[target]])
+      {
+        break;
+      }
+      target += directions[i];
+    }
+  }
+
+  return attack;
+}
+
+// Initialize slide attack tables
+void InitSlideAttack(Magic *table, u64 *attacks, const u64 *magics, const int *directions)
+{
+  for (int i = 0; i < INDEX_SIZE; ++i)
+  {
+    Magic *magic = &table[i];
+    int position = GetPositionFromIndex(i);
+    int bits = 0;
+
+    // Relevant occupancy excludes the last position of each ray
+    magic->mask = 0ULL;
+    for (int j = 0; j < 4; ++j)
+    {
+      int target = position + directions[j];
+      while (PositionToIndex[target] != INDEX_SIZE && PositionToIndex[target + directions[j]] != INDEX_SIZE)
+      {
+        magic->mask |= SetMask[PositionToIndex[target]];
+        target += directions[j];
+        bits++;
+      }
+    }
+    magic->magic = magics[i];
+    magic->shift = 64 - bits;
+    magic->attacks = attacks;
+
+    // Fill attacks for every subset of the mask
+    u64 occupancy = 0ULL;
+    do
+    {
+      u64 attack = GenerateSlideAttack(position, occupancy, directions);
+      int index = GetMagicIndex(magic, occupancy);
+      ASSERT(magic->attacks[index] == 0ULL || magic->attacks[index] == attack);
+      magic->attacks[index] = attack;
+      occupancy = (occupancy - magic->mask) & magic->mask;
+    } while (occupancy);
+
+    attacks += 1ULL << bits;
+  }
+}
+
+// Initialize line masks
+void InitLineMask()
+{
+  for (int i = 0; i < INDEX_SIZE; ++i)
+  {
+    for (int j = 0; j < INDEX_SIZE; ++j)
+    {
+      u64 ends = SetMask[i] | SetMask[j];
+
+      BetweenMask[i][j] = 0ULL;
+      LineMask[i][j] = 0ULL;
+
+      if (i == j)
+      {
+        continue;
+      }
+      if (GetBishopAttacks(i, 0ULL) & SetMask[j])
+      {
+        BetweenMask[i][j] = GetBishopAttacks(i, SetMask[j]) & GetBishopAttacks(j, SetMask[i]);
+        LineMask[i][j] = (GetBishopAttacks(i, 0ULL) & GetBishopAttacks(j, 0ULL)) | ends;
+      }
+      if (GetRookAttacks(i, 0ULL) & SetMask[j])
+      {
+        BetweenMask[i][j] = GetRookAttacks(i, SetMask[j]) & GetRookAttacks(j, SetMask[i]);
+        LineMask[i][j] = (GetRookAttacks(i, 0ULL) & GetRookAttacks(j, 0ULL)) | ends;
+      }
+    }
+  }
+}
+
+// Initialize most valuable victim, least valuable attacker scores
+void InitMvvLva()
+{
+  for (int attacker = WHITE_PAWN; attacker <= BLACK_KING; ++attacker)
+  {
+    for (int victim = WHITE_PAWN; victim <= BLACK_KING; ++victim)
+    {
+      MvvLvaScores[victim][attacker] = VictimScores[victim] + 6 - VictimScores[attacker] / 100;
+    }
+  }
+}
+
+// Initialize pawn structure masks
+void InitPawnMask()
+{
+  for (int file = FILE_A; file <= FILE_H; ++file)
+  {
+    FileMasks[file] = 0ULL;
+    for (int rank = RANK_1; rank <= RANK_8; ++rank)
+    {
+      FileMasks[file] |= SetMask[rank * 8 + file];
+    }
+  }
+
+  for (int file = FILE_A; file <= FILE_H; ++file)
+  {
+    AdjacentFileMasks[file] = (file > FILE_A ? FileMasks[file - 1] : 0ULL) | (file < FILE_H ? FileMasks[file + 1] : 0ULL);
+  }
+
+  for (int i = 0; i < INDEX_SIZE; ++i)
+  {
+    int file = i % 8;
+    int rank = i / 8;
+    u64 files = FileMasks[file] | AdjacentFileMasks[file];
+
+    PassedMasks[WHITE][i] = 0ULL;
+    PassedMasks[BLACK][i] = 0ULL;
+    SupportMasks[WHITE][i] = 0ULL;
+    SupportMasks[BLACK][i] = 0ULL;
+
+    // Passed masks cover the squares ahead, support masks the adjacent squares level or behind
+    for (int r = RANK_1; r <= RANK_8; ++r)
+    {
+      u64 row = 0xffULL << (r * 8);
+      if (r > rank)
+      {
+        PassedMasks[WHITE][i] |= files & row;
+      }
+      if (r < rank)
+      {
+        PassedMasks[BLACK][i] |= files & row;
+      }
+      if (r <= rank)
+      {
+        SupportMasks[WHITE][i] |= AdjacentFileMasks[file] & row;
+      }
+      if (r >= rank)
+      {
+        SupportMasks[BLACK][i] |= AdjacentFileMasks[file] & row;
+      }
+    }
+  }
+}
+
+// Get cuckoo table slot of a move key for either hash function
+int GetCuckooSlot(u64 key, int second)
+{
+  return (int)((second ? key >> 16 : key) & (CUCKOO_SIZE - 1));
+}
+
+// Initialize cuckoo table with the keys of every reversible piece move on an empty board
+void InitCuckoo()
+{
+  int count = 0;
+
+  for (int i = 0; i < CUCKOO_SIZE; ++i)
+  {
+    CuckooKeys[i] = 0ULL;
+    CuckooFrom[i] = 0;
+    CuckooTo[i] = 0;
+  }
+
+  for (int piece = WHITE_KNIGHT; piece <= BLACK_KING; ++piece)
   {
-    for (int j = 0; j < POSITION_SIZE; ++j)
+    if (piece == BLACK_PAWN)
+    {
+      continue;
+    }
+    for (int from = 0; from < INDEX_SIZE; ++from)
     {
-      PieceKeys[i][j] = RAND_HASH;
+      for (int to = from + 1; to < INDEX_SIZE; ++to)
+      {
+        if (!(GetPieceAttacks(piece, from, 0ULL) & SetMask[to]))
+        {
+          continue;
+        }
+
+        // Insert by displacing entries to their other slot until one lands in an empty slot
+        u64 key = PieceKeys[piece][from] ^ PieceKeys[piece][to] ^ SideKey;
+        int moveFrom = from;
+        int moveTo = to;
+        int slot = GetCuckooSlot(key, 0);
+        while (TRUE)
+        {
+          u64 tempKey = CuckooKeys[slot];
+          int tempFrom = CuckooFrom[slot];
+          int tempTo = CuckooTo[slot];
+
+          CuckooKeys[slot] = key;
+          CuckooFrom[slot] = moveFrom;
+          CuckooTo[slot] = moveTo;
+          if (tempKey == 0ULL)
+          {
+            break;
+          }
+          key = tempKey;
+          moveFrom = tempFrom;
+          moveTo = tempTo;
+          slot = slot == GetCuckooSlot(key, 0) ? GetCuckooSlot(key, 1) : GetCuckooSlot(key, 0);
+        }
+        count++;
+      }
     }
   }
-  SideKey = RAND_HASH;
-  for (int i = 0; i < CASTLE_SIZE; ++i)
+  ASSERT(count == 3668);
+}
+
+// Initialize king triangle slots
+void InitKingTriangle()
+{
+  for (int i = 0; i < INDEX_SIZE; ++i)
+  {
+    KingTriangleSlots[i] = -1;
+  }
+  for (int i = 0; i < 10; ++i)
+  {
+    KingTriangleSlots[KingTriangleIndices[i]] = i;
+  }
+}
+
+// Initialize piece-square scores, mirroring the white tables for black
+void InitPieceSquare()
+{
+  for (int type = WHITE_PAWN; type <= WHITE_KING; ++type)
   {
-    CastleKeys[i] = RAND_HASH;
+    for (int i = 0; i < INDEX_SIZE; ++i)
+    {
+      // Tables start from rank 8, so flipping the rank gives the white score
+      MiddlegamePieceSquare[type][i] = MiddlegameValues[type] + MiddlegameTables[type][i ^ 56];
+      EndgamePieceSquare[type][i] = EndgameValues[type] + EndgameTables[type][i ^ 56];
+      MiddlegamePieceSquare[type + 6][i] = MiddlegameValues[type] + MiddlegameTables[type][i];
+      EndgamePieceSquare[type + 6][i] = EndgameValues[type] + EndgameTables[type][i];
+    }
   }
 }
 
@@ -195,7 +1050,15 @@ void Init()
 {
   InitBoardConversion();
   InitBitMask();
-  InitHashKeys();
+  InitAttackMask();
+  InitSlideAttack(BishopMagicTable, BishopAttackTable, BishopMagics, BishopAttackDirection);
+  InitSlideAttack(RookMagicTable, RookAttackTable, RookMagics, RookAttackDirection);
+  InitLineMask();
+  InitMvvLva();
+  InitPieceSquare();
+  InitPawnMask();
+  InitKingTriangle();
+  InitCuckoo();
 }
 
 //// Bitboard ////
@@ -238,7 +1101,11 @@ int CountBit(u64 bit)
 // Hash piece
 void HashPiece(Board *board, const int piece, const int position)
 {
-  board->positionKey ^= PieceKeys[piece][position];
+  board->positionKey ^= PieceKeys[piece][GetIndexFromPosition(position)];
+  if (piece == WHITE_PAWN || piece == BLACK_PAWN)
+  {
+    board->pawnKey ^= PieceKeys[piece][GetIndexFromPosition(position)];
+  }
 }
 
 // Hash castle
@@ -256,7 +1123,7 @@ void HashSide(Board *board)
 // Hash en passant
 void HashEnPassant(Board *board)
 {
-  board->positionKey ^= PieceKeys[EMPTY][board->enPassant];
+  board->positionKey ^= PieceKeys[EMPTY][GetIndexFromPosition(board->enPassant)];
 }
 
 // Generate position hash key
@@ -271,7 +1138,7 @@ u64 GeneratePositionKey(const Board *board)
     if (piece != XX && piece != OB && piece != EMPTY)
     {
       ASSERT(piece >= WHITE_PAWN && piece <= BLACK_KING);
-      key ^= PieceKeys[piece][i];
+      key ^= PieceKeys[piece][GetIndexFromPosition(i)];
     }
   }
 
@@ -282,10 +1149,10 @@ u64 GeneratePositionKey(const Board *board)
   }
 
   // En passant
-  if (board->enPassant == XX)
+  if (board->enPassant != XX)
   {
-    ASSERT(board->enPassant >= 0 && board->enPassant <= POSITION_SIZE);
-    key ^= PieceKeys[EMPTY][board->enPassant];
+    ASSERT(GetIndexFromPosition(board->enPassant) != INDEX_SIZE);
+    key ^= PieceKeys[EMPTY][GetIndexFromPosition(board->enPassant)];
   }
 
   // Castle
@@ -295,6 +1162,20 @@ u64 GeneratePositionKey(const Board *board)
   return key;
 }
 
+// Generate pawn hash key
+u64 GeneratePawnKey(const Board *board)
+{
+  u64 key = 0;
+  u64 pawns = board->pawns[BOTH];
+
+  while (pawns)
+  {
+    int index = PopBit(&pawns);
+    key ^= PieceKeys[board->pieces[GetPositionFromIndex(index)]][index];
+  }
+  return key;
+}
+
 //// Validation ////
 
 // Check position is on the board
@@ -329,38 +1210,202 @@ int IsPieceValidWithoutEmpty(const int piece)
 
 //// Process ////
 
-// Reset board
-void ResetBoard(Board *board)
+// Resize board storage, which cannot continue without it, so running out of memory ends the program
+void *ResizeBoardStorage(void *memory, size_t size)
 {
-  for (int i = 0; i < POSITION_SIZE; ++i)
+  void *resized = realloc(memory, size);
+  if (resized == NULL)
   {
-    board->pieces[i] = OB;
+    printf("Failed to allocate %zu bytes of board storage\n", size);
+    exit(1);
   }
+  return resized;
+}
 
-  for (int i = 0; i < INDEX_SIZE; ++i)
+// Grow history store to hold at least a number of moves
+void ReserveHistory(Board *board, int size)
+{
+  if (size <= board->historyCapacity)
   {
-    board->pieces[GetPositionFromIndex(i)] = EMPTY;
+    return;
   }
 
-  for (int i = 0; i < SIDE_SIZE; ++i)
+  int capacity = board->historyCapacity > 0 ? board->historyCapacity : HISTORY_INITIAL_SIZE;
+  while (capacity < size)
   {
-    board->bigPieces[i] = 0;
-    board->majorPieces[i] = 0;
-    board->minorPieces[i] = 0;
-    board->materials[i] = 0;
+    capacity *= 2;
   }
+  board->history = ResizeBoardStorage(board->history, capacity * sizeof(UndoMove));
+  board->historyCapacity = capacity;
 
-  for (int i = 0; i < PLAYER_SIZE; ++i)
+  // Snapshot stacks follow the history once copy-make has created them
+  if (board->snapshots != NULL)
   {
-    board->pawns[i] = 0ULL;
+    board->snapshots = ResizeBoardStorage(board->snapshots, capacity * sizeof(Board));
   }
-
-  for (int i = 0; i < PIECE_SIZE; ++i)
+  if (board->accumulatorSnapshots != NULL)
   {
-    board->counts[i] = 0;
+    board->accumulatorSnapshots = ResizeBoardStorage(board->accumulatorSnapshots, capacity * sizeof(Accumulator));
   }
+}
 
-  board->kingSquares[WHITE] = XX;
+// Initialize board with its own history store and accumulator
+void InitBoard(Board *board)
+{
+  board->history = NULL;
+  board->historyCapacity = 0;
+  board->snapshots = NULL;
+  board->accumulatorSnapshots = NULL;
+  board->accumulator = ResizeBoardStorage(NULL, sizeof(Accumulator));
+  ReserveHistory(board, HISTORY_INITIAL_SIZE);
+}
+
+// Free history store and accumulator of a board
+void FreeBoard(Board *board)
+{
+  free(board->history);
+  free(board->accumulator);
+  free(board->snapshots);
+  free(board->accumulatorSnapshots);
+  board->history = NULL;
+  board->historyCapacity = 0;
+  board->accumulator = NULL;
+  board->snapshots = NULL;
+  board->accumulatorSnapshots = NULL;
+}
+
+// Restore storage owned by a board after its position was overwritten
+void RestoreBoardStorage(Board *board, const Board *storage)
+{
+  board->history = storage->history;
+  board->historyCapacity = storage->historyCapacity;
+  board->accumulator = storage->accumulator;
+  board->snapshots = storage->snapshots;
+  board->accumulatorSnapshots = storage->accumulatorSnapshots;
+}
+
+// Copy position, history and accumulator into an initialized board, keeping its own storage
+void CopyBoard(Board *destination, const Board *source)
+{
+  Board storage = *destination;
+
+  *destination = *source;
+  RestoreBoardStorage(destination, &storage);
+
+  ReserveHistory(destination, source->historyPly + 1);
+  memcpy(destination->history, source->history, source->historyPly * sizeof(UndoMove));
+  *destination->accumulator = *source->accumulator;
+}
+
+// Copy accumulator, skipping perspectives waiting for a refresh
+void SaveAccumulator(Accumulator *destination, const Accumulator *source)
+{
+  for (int perspective = WHITE; perspective <= BLACK; ++perspective)
+  {
+    destination->dirty[perspective] = source->dirty[perspective];
+    if (!source->dirty[perspective])
+    {
+      memcpy(destination->values[perspective], source->values[perspective], sizeof(source->values[perspective]));
+    }
+  }
+}
+
+// Save position before a move in copy-make mode
+void SaveSnapshot(Board *board)
+{
+  if (board->snapshots == NULL)
+  {
+    board->snapshots = ResizeBoardStorage(NULL, board->historyCapacity * sizeof(Board));
+  }
+  board->snapshots[board->historyPly] = *board;
+
+  // The accumulator lives outside the board, so it has its own stack
+  if (NnueLoaded)
+  {
+    if (board->accumulatorSnapshots == NULL)
+    {
+      board->accumulatorSnapshots = ResizeBoardStorage(NULL, board->historyCapacity * sizeof(Accumulator));
+    }
+    SaveAccumulator(&board->accumulatorSnapshots[board->historyPly], board->accumulator);
+  }
+}
+
+// Restore position saved before the last move in copy-make mode
+void RestoreSnapshot(Board *board)
+{
+  Board storage = *board;
+
+  *board = board->snapshots[board->historyPly - 1];
+  RestoreBoardStorage(board, &storage);
+  if (NnueLoaded)
+  {
+    SaveAccumulator(board->accumulator, &board->accumulatorSnapshots[board->historyPly]);
+  }
+}
+
+// Save the perspective of a side before its king moves, since undoing the move cannot restore it incrementally
+void SaveKingPerspective(Board *board, int side)
+{
+  if (board->accumulatorSnapshots == NULL)
+  {
+    board->accumulatorSnapshots = ResizeBoardStorage(NULL, board->historyCapacity * sizeof(Accumulator));
+  }
+
+  Accumulator *snapshot = &board->accumulatorSnapshots[board->historyPly];
+  snapshot->dirty[side] = board->accumulator->dirty[side];
+  if (!snapshot->dirty[side])
+  {
+    memcpy(snapshot->values[side], board->accumulator->values[side], sizeof(snapshot->values[side]));
+  }
+}
+
+// Restore the perspective of a side saved before its king moved
+void RestoreKingPerspective(Board *board, int side)
+{
+  const Accumulator *snapshot = &board->accumulatorSnapshots[board->historyPly];
+  board->accumulator->dirty[side] = snapshot->dirty[side];
+  if (!snapshot->dirty[side])
+  {
+    memcpy(board->accumulator->values[side], snapshot->values[side], sizeof(snapshot->values[side]));
+  }
+}
+
+// Reset board
+void ResetBoard(Board *board)
+{
+  for (int i = 0; i < POSITION_SIZE; ++i)
+  {
+    board->pieces[i] = OB;
+  }
+
+  for (int i = 0; i < INDEX_SIZE; ++i)
+  {
+    board->pieces[GetPositionFromIndex(i)] = EMPTY;
+  }
+
+  for (int i = 0; i < SIDE_SIZE; ++i)
+  {
+    board->bigPieces[i] = 0;
+    board->majorPieces[i] = 0;
+    board->minorPieces[i] = 0;
+    board->materials[i] = 0;
+    board->middlegameScores[i] = 0;
+    board->endgameScores[i] = 0;
+  }
+
+  for (int i = 0; i < PLAYER_SIZE; ++i)
+  {
+    board->pawns[i] = 0ULL;
+    board->occupancy[i] = 0ULL;
+  }
+
+  for (int i = 0; i < PIECE_SIZE; ++i)
+  {
+    board->counts[i] = 0;
+    board->bitboards[i] = 0ULL;
+  }
+
+  board->kingSquares[WHITE] = XX;
   board->kingSquares[BLACK] = XX;
   board->side = BOTH;
   board->castle = 0;
@@ -369,9 +1414,13 @@ void ResetBoard(Board *board)
   board->currentPly = 0;
   board->historyPly = 0;
   board->positionKey = 0ULL;
+  board->pawnKey = 0ULL;
+  board->accumulator->dirty[WHITE] = TRUE;
+  board->accumulator->dirty[BLACK] = TRUE;
 }
 
-// Check board
+// Check board, only used by debug assertions
+#ifdef DEBUG
 int CheckBoard(const Board *board)
 {
   int counts[PIECE_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
@@ -379,6 +1428,10 @@ int CheckBoard(const Board *board)
   int majorPieces[SIDE_SIZE] = { 0, 0 };
   int minorPieces[SIDE_SIZE] = { 0, 0 };
   int materials[SIDE_SIZE] = { 0, 0 };
+  int middlegameScores[SIDE_SIZE] = { 0, 0 };
+  int endgameScores[SIDE_SIZE] = { 0, 0 };
+  u64 bitboards[PIECE_SIZE] = { 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL, 0ULL };
+  u64 occupancy[PLAYER_SIZE] = { 0ULL, 0ULL, 0ULL };
 
   u64 pawns[PLAYER_SIZE] = { 0ULL, 0ULL, 0ULL };
   pawns[WHITE] = board->pawns[WHITE];
@@ -416,6 +1469,15 @@ int CheckBoard(const Board *board)
       minorPieces[color]++;
     }
     materials[color] += PieceValues[piece];
+    middlegameScores[color] += MiddlegamePieceSquare[piece][i];
+    endgameScores[color] += EndgamePieceSquare[piece][i];
+
+    if (piece != EMPTY)
+    {
+      SetBit(&bitboards[piece], i);
+      SetBit(&occupancy[color], i);
+      SetBit(&occupancy[BOTH], i);
+    }
   }
 
   // Check piece counts
@@ -454,6 +1516,14 @@ int CheckBoard(const Board *board)
     ASSERT(piece == WHITE_PAWN || piece == BLACK_PAWN);
   }
 
+  for (int i = WHITE_PAWN; i <= BLACK_KING; ++i)
+  {
+    ASSERT(bitboards[i] == board->bitboards[i]);
+  }
+  ASSERT(occupancy[WHITE] == board->occupancy[WHITE]);
+  ASSERT(occupancy[BLACK] == board->occupancy[BLACK]);
+  ASSERT(occupancy[BOTH] == board->occupancy[BOTH]);
+
   // Check materials
   ASSERT(bigPieces[WHITE] == board->bigPieces[WHITE]);
   ASSERT(bigPieces[BLACK] == board->bigPieces[BLACK]);
@@ -463,10 +1533,15 @@ int CheckBoard(const Board *board)
   ASSERT(minorPieces[BLACK] == board->minorPieces[BLACK]);
   ASSERT(materials[WHITE] == board->materials[WHITE]);
   ASSERT(materials[BLACK] == board->materials[BLACK]);
+  ASSERT(middlegameScores[WHITE] == board->middlegameScores[WHITE]);
+  ASSERT(middlegameScores[BLACK] == board->middlegameScores[BLACK]);
+  ASSERT(endgameScores[WHITE] == board->endgameScores[WHITE]);
+  ASSERT(endgameScores[BLACK] == board->endgameScores[BLACK]);
 
   // Check general information
   ASSERT(board->side == WHITE || board->side == BLACK);
   ASSERT(GeneratePositionKey(board) == board->positionKey);
+  ASSERT(GeneratePawnKey(board) == board->pawnKey);
 
   int isWhiteEnPassant = board->side == WHITE && PositionToRank[board->enPassant] == RANK_6;
   int isBlackEnPassant = board->side == BLACK && PositionToRank[board->enPassant] == RANK_3;
@@ -478,15 +1553,29 @@ int CheckBoard(const Board *board)
   // Return
   return TRUE;
 }
+#endif
 
 //// Attack ////
 
+// Get pieces of both sides attacking index with given occupancy
+u64 GetAttackers(const Board *board, const int index, const u64 occupancy)
+{
+  u64 bishopsOrQueens = board->bitboards[WHITE_BISHOP] | board->bitboards[WHITE_QUEEN] | board->bitboards[BLACK_BISHOP] | board->bitboards[BLACK_QUEEN];
+  u64 rooksOrQueens = board->bitboards[WHITE_ROOK] | board->bitboards[WHITE_QUEEN] | board->bitboards[BLACK_ROOK] | board->bitboards[BLACK_QUEEN];
+
+  return (PawnAttacks[BLACK][index] & board->bitboards[WHITE_PAWN])
+    | (PawnAttacks[WHITE][index] & board->bitboards[BLACK_PAWN])
+    | (KnightAttacks[index] & (board->bitboards[WHITE_KNIGHT] | board->bitboards[BLACK_KNIGHT]))
+    | (KingAttacks[index] & (board->bitboards[WHITE_KING] | board->bitboards[BLACK_KING]))
+    | (GetBishopAttacks(index, occupancy) & bishopsOrQueens)
+    | (GetRookAttacks(index, occupancy) & rooksOrQueens);
+}
+
 // Check whether position is being attacked
 int IsPositionAttacked(const int position, const int side, const Board *board)
 {
-  int piece = EMPTY;
-  int direction = 0;
-  int temp = position;
+  int index = GetIndexFromPosition(position);
+  u64 queens = board->bitboards[side == WHITE ? WHITE_QUEEN : BLACK_QUEEN];
 
   // Assert
   ASSERT(IsPositionOnBoard(position));
@@ -496,84 +1585,333 @@ int IsPositionAttacked(const int position, const int side, const Board *board)
   // Pawns
   if (side == WHITE)
   {
-    if (board->pieces[position - 11] == WHITE_PAWN || board->pieces[position - 9] == WHITE_PAWN)
+    if (PawnAttacks[BLACK][index] & board->bitboards[WHITE_PAWN])
     {
       return TRUE;
     }
   }
   else
   {
-    if (board->pieces[position + 9] == BLACK_PAWN || board->pieces[position + 11] == BLACK_PAWN)
+    if (PawnAttacks[WHITE][index] & board->bitboards[BLACK_PAWN])
     {
       return TRUE;
     }
   }
 
   // Knights
-  for (int i = 0; i < 8; ++i)
+  if (KnightAttacks[index] & board->bitboards[side == WHITE ? WHITE_KNIGHT : BLACK_KNIGHT])
   {
-    piece = board->pieces[position + KnightAttackDirection[i]];
-    if (piece != OB && KnightPieces[piece] && PieceColors[piece] == side)
-    {
-      return TRUE;
-    }
+    return TRUE;
+  }
+
+  // Kings
+  if (KingAttacks[index] & board->bitboards[side == WHITE ? WHITE_KING : BLACK_KING])
+  {
+    return TRUE;
   }
 
   // Bishops or queens
-  for (int i = 0; i < 4; ++i)
+  if (GetBishopAttacks(index, board->occupancy[BOTH]) & (board->bitboards[side == WHITE ? WHITE_BISHOP : BLACK_BISHOP] | queens))
+  {
+    return TRUE;
+  }
+
+  // Rooks or queens
+  if (GetRookAttacks(index, board->occupancy[BOTH]) & (board->bitboards[side == WHITE ? WHITE_ROOK : BLACK_ROOK] | queens))
+  {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+//// NNUE ////
+
+// Get HalfKP feature index of a piece seen from a perspective
+int GetFeatureIndex(int perspective, int piece, int index, int kingIndex)
+{
+  // Black sees the board rotated, with its own pieces as the friendly ones
+  if (perspective == BLACK)
+  {
+    index ^= 63;
+    kingIndex ^= 63;
+  }
+  return FeaturePieceOffsets[perspective][piece] + index + NNUE_PIECE_SQUARES * kingIndex;
+}
+
+// Add feature weights to accumulator values
+void AddFeatureWeights(int16_t *values, const int16_t *weights)
+{
+#if defined(USE_AVX2)
+  for (int i = 0; i < NNUE_HIDDEN; i += 16)
+  {
+    __m256i sum = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)&values[i]), _mm256_loadu_si256((const __m256i *)&weights[i]));
+    _mm256_storeu_si256((__m256i *)&values[i], sum);
+  }
+#elif defined(USE_SSE41)
+  for (int i = 0; i < NNUE_HIDDEN; i += 8)
+  {
+    __m128i sum = _mm_add_epi16(_mm_loadu_si128((const __m128i *)&values[i]), _mm_loadu_si128((const __m128i *)&weights[i]));
+    _mm_storeu_si128((__m128i *)&values[i], sum);
+  }
+#else
+  for (int i = 0; i < NNUE_HIDDEN; ++i)
+  {
+    values[i] += weights[i];
+  }
+#endif
+}
+
+// Subtract feature weights from accumulator values
+void SubFeatureWeights(int16_t *values, const int16_t *weights)
+{
+#if defined(USE_AVX2)
+  for (int i = 0; i < NNUE_HIDDEN; i += 16)
+  {
+    __m256i difference = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)&values[i]), _mm256_loadu_si256((const __m256i *)&weights[i]));
+    _mm256_storeu_si256((__m256i *)&values[i], difference);
+  }
+#elif defined(USE_SSE41)
+  for (int i = 0; i < NNUE_HIDDEN; i += 8)
   {
-    direction = BishopAttackDirection[i];
-    temp = position + direction;
-    piece = board->pieces[temp];
+    __m128i difference = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)&values[i]), _mm_loadu_si128((const __m128i *)&weights[i]));
+    _mm_storeu_si128((__m128i *)&values[i], difference);
+  }
+#else
+  for (int i = 0; i < NNUE_HIDDEN; ++i)
+  {
+    values[i] -= weights[i];
+  }
+#endif
+}
+
+// Get feature weights of a piece seen from a perspective
+const int16_t *GetFeatureWeights(const Board *board, int perspective, int piece, int index)
+{
+  int kingIndex = GetIndexFromPosition(board->kingSquares[perspective]);
+  return &Nnue.featureWeights[(size_t)GetFeatureIndex(perspective, piece, index, kingIndex) * NNUE_HIDDEN];
+}
 
-    while (piece != OB)
+// Compute accumulator values of a perspective from scratch
+void ComputeAccumulator(const Board *board, int perspective, int16_t *values)
+{
+  memcpy(values, Nnue.featureBiases, NNUE_HIDDEN * sizeof(int16_t));
+
+  for (int piece = WHITE_PAWN; piece <= BLACK_KING; ++piece)
+  {
+    if (KingPieces[piece])
     {
-      if (piece != EMPTY)
-      {
-        if (BishopOrQueenPieces[piece] && PieceColors[piece] == side)
-        {
-          return TRUE;
-        }
-        break;
-      }
-      temp += direction;
-      piece = board->pieces[temp];
+      continue;
+    }
+
+    u64 pieces = board->bitboards[piece];
+    while (pieces)
+    {
+      AddFeatureWeights(values, GetFeatureWeights(board, perspective, piece, PopBit(&pieces)));
     }
   }
+}
 
-  // Rooks or queens
-  for (int i = 0; i < 4; ++i)
+// Refresh accumulator perspectives invalidated by king moves, returning the number refreshed
+int RefreshAccumulator(Board *board)
+{
+  int refreshed = 0;
+
+  for (int perspective = WHITE; perspective <= BLACK; ++perspective)
   {
-    direction = RookAttackDirection[i];
-    temp = position + direction;
-    piece = board->pieces[temp];
+    if (board->accumulator->dirty[perspective])
+    {
+      ComputeAccumulator(board, perspective, board->accumulator->values[perspective]);
+      board->accumulator->dirty[perspective] = FALSE;
+      refreshed++;
+    }
+  }
+  return refreshed;
+}
 
-    while (piece != OB)
+// Update accumulator for a piece added to the board
+void NnueAddPiece(Board *board, int piece, int index)
+{
+  for (int perspective = WHITE; perspective <= BLACK; ++perspective)
+  {
+    if (!board->accumulator->dirty[perspective])
     {
-      if (piece != EMPTY)
-      {
-        if (RookOrQueenPieces[piece] && PieceColors[piece] == side)
-        {
-          return TRUE;
-        }
-        break;
-      }
-      temp += direction;
-      piece = board->pieces[temp];
+      AddFeatureWeights(board->accumulator->values[perspective], GetFeatureWeights(board, perspective, piece, index));
     }
   }
+}
 
-  // Kings
-  for (int i = 0; i < 8; ++i)
+// Update accumulator for a piece cleared from the board
+void NnueClearPiece(Board *board, int piece, int index)
+{
+  for (int perspective = WHITE; perspective <= BLACK; ++perspective)
   {
-    piece = board->pieces[position + KingAttackDirection[i]];
-    if (KingPieces[piece] && PieceColors[piece] == side)
+    if (!board->accumulator->dirty[perspective])
     {
-      return TRUE;
+      SubFeatureWeights(board->accumulator->values[perspective], GetFeatureWeights(board, perspective, piece, index));
     }
   }
+}
 
-  return FALSE;
+// Update accumulator for a piece moved on the board
+void NnueMovePiece(Board *board, int piece, int from, int to)
+{
+  // Every feature of the king's own perspective depends on its square, so refresh it later
+  if (KingPieces[piece])
+  {
+    board->accumulator->dirty[PieceColors[piece]] = TRUE;
+    return;
+  }
+
+  NnueClearPiece(board, piece, from);
+  NnueAddPiece(board, piece, to);
+}
+
+// Clip accumulator values to the range of the first layer inputs
+void TransformFeatures(const int16_t *values, uint8_t *output)
+{
+#if defined(USE_AVX2)
+  const __m256i zero = _mm256_setzero_si256();
+  for (int i = 0; i < NNUE_HIDDEN; i += 32)
+  {
+    __m256i low = _mm256_loadu_si256((const __m256i *)&values[i]);
+    __m256i high = _mm256_loadu_si256((const __m256i *)&values[i + 16]);
+
+    // Packing works within 128-bit lanes, so restore the order afterwards
+    __m256i packed = _mm256_max_epi8(_mm256_packs_epi16(low, high), zero);
+    _mm256_storeu_si256((__m256i *)&output[i], _mm256_permute4x64_epi64(packed, 0xd8));
+  }
+#elif defined(USE_SSE41)
+  const __m128i zero = _mm_setzero_si128();
+  for (int i = 0; i < NNUE_HIDDEN; i += 16)
+  {
+    __m128i low = _mm_loadu_si128((const __m128i *)&values[i]);
+    __m128i high = _mm_loadu_si128((const __m128i *)&values[i + 8]);
+    _mm_storeu_si128((__m128i *)&output[i], _mm_max_epi8(_mm_packs_epi16(low, high), zero));
+  }
+#else
+  for (int i = 0; i < NNUE_HIDDEN; ++i)
+  {
+    output[i] = values[i] < 0 ? 0 : values[i] > 127 ? 127 : values[i];
+  }
+#endif
+}
+
+// Get dot product of unsigned inputs and signed weights, with a size divisible by 32
+int32_t DotProduct(const uint8_t *input, const int8_t *weights, int size)
+{
+#if defined(USE_AVX2)
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i sum = _mm256_setzero_si256();
+  for (int i = 0; i < size; i += 32)
+  {
+    __m256i product = _mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *)&input[i]), _mm256_loadu_si256((const __m256i *)&weights[i]));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(product, ones));
+  }
+
+  __m128i total = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0x4e));
+  total = _mm_add_epi32(total, _mm_shuffle_epi32(total, 0xb1));
+  return _mm_cvtsi128_si32(total);
+#elif defined(USE_SSE41)
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i sum = _mm_setzero_si128();
+  for (int i = 0; i < size; i += 16)
+  {
+    __m128i product = _mm_maddubs_epi16(_mm_loadu_si128((const __m128i *)&input[i]), _mm_loadu_si128((const __m128i *)&weights[i]));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(product, ones));
+  }
+
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+#else
+  int32_t sum = 0;
+  for (int i = 0; i < size; ++i)
+  {
+    sum += input[i] * weights[i];
+  }
+  return sum;
+#endif
+}
+
+// Apply dense layer followed by clipped ReLU
+void DenseLayer(const uint8_t *input, int inputs, const int8_t *weights, const int32_t *biases, int outputs, uint8_t *output)
+{
+  for (int i = 0; i < outputs; ++i)
+  {
+    int32_t sum = (biases[i] + DotProduct(input, &weights[i * inputs], inputs)) >> NNUE_SHIFT;
+    output[i] = sum < 0 ? 0 : sum > 127 ? 127 : sum;
+  }
+}
+
+// Evaluate position with the network from the side to move
+int NnueEvaluate(Board *board)
+{
+  uint8_t input[2 * NNUE_HIDDEN];
+  uint8_t first[NNUE_LAYER_SIZE];
+  uint8_t second[NNUE_LAYER_SIZE];
+
+  RefreshAccumulator(board);
+  TransformFeatures(board->accumulator->values[board->side], input);
+  TransformFeatures(board->accumulator->values[board->side ^ 1], &input[NNUE_HIDDEN]);
+
+  DenseLayer(input, 2 * NNUE_HIDDEN, &Nnue.firstWeights[0][0], Nnue.firstBiases, NNUE_LAYER_SIZE, first);
+  DenseLayer(first, NNUE_LAYER_SIZE, &Nnue.secondWeights[0][0], Nnue.secondBiases, NNUE_LAYER_SIZE, second);
+
+  return (Nnue.outputBias + DotProduct(second, Nnue.outputWeights, NNUE_LAYER_SIZE)) / NNUE_SCALE;
+}
+
+// Read values from network file, returning whether all were read
+int ReadNetwork(FILE *file, void *values, size_t size, size_t count)
+{
+  return fread(values, size, count, file) == count;
+}
+
+// Load network in the HalfKP 256x2-32-32 format, switching evaluation to it on success
+int LoadNetwork(const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  uint32_t header[3];
+  uint32_t hash = 0;
+  int ok = TRUE;
+
+  if (file == NULL)
+  {
+    return FALSE;
+  }
+
+  if (Nnue.featureWeights == NULL)
+  {
+    Nnue.featureBiases = malloc(NNUE_HIDDEN * sizeof(int16_t));
+    Nnue.featureWeights = malloc((size_t)NNUE_INPUTS * NNUE_HIDDEN * sizeof(int16_t));
+  }
+  NnueLoaded = FALSE;
+
+  // Version, hash and description length, then the description itself
+  ok = ok && ReadNetwork(file, header, sizeof(uint32_t), 3) && header[0] == NNUE_VERSION;
+  ok = ok && fseek(file, header[2], SEEK_CUR) == 0;
+
+  // Feature transformer
+  ok = ok && ReadNetwork(file, &hash, sizeof(uint32_t), 1);
+  ok = ok && ReadNetwork(file, Nnue.featureBiases, sizeof(int16_t), NNUE_HIDDEN);
+  ok = ok && ReadNetwork(file, Nnue.featureWeights, sizeof(int16_t), (size_t)NNUE_INPUTS * NNUE_HIDDEN);
+
+  // Dense layers
+  ok = ok && ReadNetwork(file, &hash, sizeof(uint32_t), 1);
+  ok = ok && ReadNetwork(file, Nnue.firstBiases, sizeof(int32_t), NNUE_LAYER_SIZE);
+  ok = ok && ReadNetwork(file, Nnue.firstWeights, sizeof(int8_t), NNUE_LAYER_SIZE * 2 * NNUE_HIDDEN);
+  ok = ok && ReadNetwork(file, Nnue.secondBiases, sizeof(int32_t), NNUE_LAYER_SIZE);
+  ok = ok && ReadNetwork(file, Nnue.secondWeights, sizeof(int8_t), NNUE_LAYER_SIZE * NNUE_LAYER_SIZE);
+  ok = ok && ReadNetwork(file, &Nnue.outputBias, sizeof(int32_t), 1);
+  ok = ok && ReadNetwork(file, Nnue.outputWeights, sizeof(int8_t), NNUE_LAYER_SIZE);
+
+  // Nothing may follow the output layer
+  ok = ok && fgetc(file) == EOF;
+  fclose(file);
+
+  NnueLoaded = ok;
+  return ok;
 }
 
 //// Move ////
@@ -642,27 +1980,79 @@ int GenerateMoveKey(int from, int to, int capture, int promotion, int flag)
   return from | (to << 7) | (capture << 14) | (promotion << 20) | flag;
 }
 
-// Add quiet move to move list
+// Get compact move with from and to indices in bits 0-11, promotion type in 12-13 and move type in 14-15
+CompactMove GetCompactFromMoveKey(int move)
+{
+  if (move == NO_MOVE)
+  {
+    return NO_MOVE;
+  }
+
+  int promotion = GetPromotionFromMoveKey(move);
+  int type = promotion != EMPTY ? COMPACT_PROMOTION : move & FLAG_EN_PASSANT ? COMPACT_EN_PASSANT : move & FLAG_CASTLE ? COMPACT_CASTLE : COMPACT_NORMAL;
+  int from = GetIndexFromPosition(GetFromPositionFromMoveKey(move));
+  int to = GetIndexFromPosition(GetToPositionFromMoveKey(move));
+
+  return (CompactMove)(from | (to << 6) | ((promotion != EMPTY ? (promotion - WHITE_KNIGHT) % 6 : 0) << 12) | (type << 14));
+}
+
+// Get move key of a compact move in the position it is played from, restoring the capture and flags
+int GetMoveKeyFromCompact(const Board *board, int compact)
+{
+  if (compact == NO_MOVE)
+  {
+    return NO_MOVE;
+  }
+
+  int from = GetPositionFromIndex(compact & 0x3f);
+  int to = GetPositionFromIndex((compact >> 6) & 0x3f);
+  int piece = board->pieces[from];
+
+  switch (compact >> 14)
+  {
+  case COMPACT_PROMOTION:
+    return GenerateMoveKey(from, to, board->pieces[to], WHITE_KNIGHT + ((compact >> 12) & 0x3) + 6 * board->side, FLAG_EMPTY);
+  case COMPACT_EN_PASSANT:
+    return GenerateMoveKey(from, to, EMPTY, EMPTY, FLAG_EN_PASSANT);
+  case COMPACT_CASTLE:
+    return GenerateMoveKey(from, to, EMPTY, EMPTY, FLAG_CASTLE);
+  default:
+    return GenerateMoveKey(from, to, board->pieces[to], EMPTY, (piece == WHITE_PAWN || piece == BLACK_PAWN) && (to - from == 20 || from - to == 20) ? FLAG_PAWN_START : FLAG_EMPTY);
+  }
+}
+
+// Get coordinate notation of a compact move
+char *GetStringFromCompact(int compact)
+{
+  int promotion = (compact >> 14) == COMPACT_PROMOTION ? WHITE_KNIGHT + ((compact >> 12) & 0x3) : EMPTY;
+  return GetStringFromMoveKey(GenerateMoveKey(GetPositionFromIndex(compact & 0x3f), GetPositionFromIndex((compact >> 6) & 0x3f), EMPTY, promotion, FLAG_EMPTY));
+}
+
+// Add quiet move to move list, with promotions ordered among the captures
 void AddQuietMove(const Board *board, int move, MoveList *list)
 {
-  list->moves[list->count].move = move;
-  list->moves[list->count].score = 0;
+  int promotion = GetPromotionFromMoveKey(move);
+
+  list->moves[list->count] = GetCompactFromMoveKey(move);
+  list->scores[list->count] = promotion != EMPTY ? CAPTURE_SCORE + VictimScores[promotion] - 100 : 0;
   list->count++;
 }
 
 // Add capture move to move list
 void AddCaptureMove(const Board *board, int move, MoveList *list)
 {
-  list->moves[list->count].move = move;
-  list->moves[list->count].score = 0;
+  int from = GetFromPositionFromMoveKey(move);
+
+  list->moves[list->count] = GetCompactFromMoveKey(move);
+  list->scores[list->count] = CAPTURE_SCORE + MvvLvaScores[GetCaptureFromMoveKey(move)][board->pieces[from]];
   list->count++;
 }
 
 // Add en passant move to move list
 void AddEnPassantMove(const Board *board, int move, MoveList *list)
 {
-  list->moves[list->count].move = move;
-  list->moves[list->count].score = 0;
+  list->moves[list->count] = GetCompactFromMoveKey(move);
+  list->scores[list->count] = CAPTURE_SCORE + MvvLvaScores[WHITE_PAWN][WHITE_PAWN];
   list->count++;
 }
 
@@ -744,45 +2134,38 @@ void AddBlackPawnQuietMove(const Board *board, const int from, const int to, Mov
   }
 }
 
-// Generate all moves to move list
-void GenerateAllMoves(const Board *board, MoveList *list)
+// Generate captures and promotions to move list
+void GenerateAllCaptures(const Board *board, MoveList *list)
 {
   // Setup
   int position = EMPTY;
   int target = EMPTY;
-  int direction = 0;
   int pieceIndex = 0;
   int piece = 0;
+  u64 attacks = 0ULL;
+  u64 enemies = board->occupancy[board->side ^ 1];
 
   ASSERT(CheckBoard(board));
   list->count = 0;
 
-  // Generate pawn moves
+  // Generate pawn captures and promotions
   if (board->side == WHITE)
   {
-    // White pawn
     for (int i = 0; i < board->counts[WHITE_PAWN]; ++i)
     {
       position = board->pieceList[WHITE_PAWN][i];
       ASSERT(IsPositionOnBoard(position));
 
-      if (board->pieces[position + 10] == EMPTY)
+      if (PositionToRank[position] == RANK_7 && board->pieces[position + 10] == EMPTY)
       {
         AddWhitePawnQuietMove(board, position, position + 10, list);
-        if (PositionToRank[position] == RANK_2 && board->pieces[position + 20] == EMPTY)
-        {
-          AddQuietMove(board, GenerateMoveKey(position, position + 20, EMPTY, EMPTY, FLAG_PAWN_START), list);
-        }
       }
 
-      if (IsPositionOnBoard(position + 9) && PieceColors[board->pieces[position + 9]] == BLACK)
+      attacks = PawnAttacks[WHITE][GetIndexFromPosition(position)] & enemies;
+      while (attacks)
       {
-        AddWhitePawnCaptureMove(board, position, position + 9, board->pieces[position + 9], list);
-      }
-
-      if (IsPositionOnBoard(position + 11) && PieceColors[board->pieces[position + 11]] == BLACK)
-      {
-        AddWhitePawnCaptureMove(board, position, position + 11, board->pieces[position + 11], list);
+        target = GetPositionFromIndex(PopBit(&attacks));
+        AddWhitePawnCaptureMove(board, position, target, board->pieces[target], list);
       }
 
       if (board->enPassant != XX)
@@ -798,75 +2181,160 @@ void GenerateAllMoves(const Board *board, MoveList *list)
         }
       }
     }
+  }
+  else
+  {
+    for (int i = 0; i < board->counts[BLACK_PAWN]; ++i)
+    {
+      position = board->pieceList[BLACK_PAWN][i];
+      ASSERT(IsPositionOnBoard(position));
 
-    // White castling
-    if (board->castle & CASTLE_WHITE_KING)
+      if (PositionToRank[position] == RANK_2 && board->pieces[position - 10] == EMPTY)
+      {
+        AddBlackPawnQuietMove(board, position, position - 10, list);
+      }
+
+      attacks = PawnAttacks[BLACK][GetIndexFromPosition(position)] & enemies;
+      while (attacks)
+      {
+        target = GetPositionFromIndex(PopBit(&attacks));
+        AddBlackPawnCaptureMove(board, position, target, board->pieces[target], list);
+      }
+
+      if (board->enPassant != XX)
+      {
+        if (position - 9 == board->enPassant)
+        {
+          AddEnPassantMove(board, GenerateMoveKey(position, position - 9, EMPTY, EMPTY, FLAG_EN_PASSANT), list);
+        }
+
+        if (position - 11 == board->enPassant)
+        {
+          AddEnPassantMove(board, GenerateMoveKey(position, position - 11, EMPTY, EMPTY, FLAG_EN_PASSANT), list);
+        }
+      }
+    }
+  }
+
+  // Generate slide piece captures
+  pieceIndex = LoopSlideIndex[board->side];
+  piece = SlidePieceIterator[pieceIndex++];
+  while (piece != EMPTY)
+  {
+    ASSERT(IsPieceValidWithoutEmpty(piece));
+
+    for (int i = 0; i < board->counts[piece]; ++i)
     {
-      int isPathCleared = board->pieces[F1] == EMPTY && board->pieces[G1] == EMPTY;
-      int isPositionSafe = !IsPositionAttacked(E1, BLACK, board) && !IsPositionAttacked(F1, BLACK, board);
-      if (isPathCleared && isPositionSafe)
+      position = board->pieceList[piece][i];
+      ASSERT(IsPositionOnBoard(position));
+
+      attacks = GetPieceAttacks(piece, GetIndexFromPosition(position), board->occupancy[BOTH]) & enemies;
+      while (attacks)
       {
-        AddQuietMove(board, GenerateMoveKey(E1, G1, EMPTY, EMPTY, FLAG_CASTLE), list);
+        target = GetPositionFromIndex(PopBit(&attacks));
+        AddCaptureMove(board, GenerateMoveKey(position, target, board->pieces[target], EMPTY, FLAG_EMPTY), list);
       }
     }
 
-    if (board->castle & CASTLE_WHITE_QUEEN)
+    piece = SlidePieceIterator[pieceIndex++];
+  }
+
+  // Generate non-slide piece captures
+  pieceIndex = LoopNonSlideIndex[board->side];
+  piece = NonSlidePieceIterator[pieceIndex++];
+  while (piece != EMPTY)
+  {
+    ASSERT(IsPieceValidWithoutEmpty(piece));
+
+    for (int i = 0; i < board->counts[piece]; ++i)
     {
-      int isPathCleared = board->pieces[D1] == EMPTY && board->pieces[C1] == EMPTY && board->pieces[B1] == EMPTY;
-      int isPositionSafe = !IsPositionAttacked(E1, BLACK, board) && !IsPositionAttacked(D1, BLACK, board);
-      if (isPathCleared && isPositionSafe)
+      position = board->pieceList[piece][i];
+      ASSERT(IsPositionOnBoard(position));
+
+      attacks = KnightPieces[piece] ? KnightAttacks[GetIndexFromPosition(position)] : KingAttacks[GetIndexFromPosition(position)];
+      attacks &= enemies;
+      while (attacks)
       {
-        AddQuietMove(board, GenerateMoveKey(E1, C1, EMPTY, EMPTY, FLAG_CASTLE), list);
+        target = GetPositionFromIndex(PopBit(&attacks));
+        AddCaptureMove(board, GenerateMoveKey(position, target, board->pieces[target], EMPTY, FLAG_EMPTY), list);
       }
     }
+
+    piece = NonSlidePieceIterator[pieceIndex++];
   }
-  else
+}
+
+// Generate quiet moves without promotions to move list
+void GenerateAllQuiets(const Board *board, MoveList *list)
+{
+  // Setup
+  int position = EMPTY;
+  int target = EMPTY;
+  int pieceIndex = 0;
+  int piece = 0;
+  u64 attacks = 0ULL;
+  u64 empty = ~board->occupancy[BOTH];
+
+  ASSERT(CheckBoard(board));
+  list->count = 0;
+
+  // Generate pawn pushes and castling
+  if (board->side == WHITE)
   {
-    // Black pawn
-    for (int i = 0; i < board->counts[BLACK_PAWN]; ++i)
+    for (int i = 0; i < board->counts[WHITE_PAWN]; ++i)
     {
-      position = board->pieceList[BLACK_PAWN][i];
+      position = board->pieceList[WHITE_PAWN][i];
       ASSERT(IsPositionOnBoard(position));
 
-      if (board->pieces[position - 10] == EMPTY)
+      if (PositionToRank[position] != RANK_7 && board->pieces[position + 10] == EMPTY)
       {
-        AddBlackPawnQuietMove(board, position, position - 10, list);
-        if (PositionToRank[position] == RANK_7 && board->pieces[position - 20] == EMPTY)
+        AddQuietMove(board, GenerateMoveKey(position, position + 10, EMPTY, EMPTY, FLAG_EMPTY), list);
+        if (PositionToRank[position] == RANK_2 && board->pieces[position + 20] == EMPTY)
         {
-          AddQuietMove(board, GenerateMoveKey(position, position - 20, EMPTY, EMPTY, FLAG_PAWN_START), list);
+          AddQuietMove(board, GenerateMoveKey(position, position + 20, EMPTY, EMPTY, FLAG_PAWN_START), list);
         }
       }
+    }
 
-      if (IsPositionOnBoard(position - 9) && PieceColors[board->pieces[position - 9]] == WHITE)
+    if (board->castle & CASTLE_WHITE_KING)
+    {
+      int isPathCleared = board->pieces[F1] == EMPTY && board->pieces[G1] == EMPTY;
+      if (isPathCleared && !IsPositionAttacked(E1, BLACK, board) && !IsPositionAttacked(F1, BLACK, board))
       {
-        AddBlackPawnCaptureMove(board, position, position - 9, board->pieces[position - 9], list);
+        AddQuietMove(board, GenerateMoveKey(E1, G1, EMPTY, EMPTY, FLAG_CASTLE), list);
       }
+    }
 
-      if (IsPositionOnBoard(position - 11) && PieceColors[board->pieces[position - 11]] == WHITE)
+    if (board->castle & CASTLE_WHITE_QUEEN)
+    {
+      int isPathCleared = board->pieces[D1] == EMPTY && board->pieces[C1] == EMPTY && board->pieces[B1] == EMPTY;
+      if (isPathCleared && !IsPositionAttacked(E1, BLACK, board) && !IsPositionAttacked(D1, BLACK, board))
       {
-        AddBlackPawnCaptureMove(board, position, position - 11, board->pieces[position - 11], list);
+        AddQuietMove(board, GenerateMoveKey(E1, C1, EMPTY, EMPTY, FLAG_CASTLE), list);
       }
+    }
+  }
+  else
+  {
+    for (int i = 0; i < board->counts[BLACK_PAWN]; ++i)
+    {
+      position = board->pieceList[BLACK_PAWN][i];
+      ASSERT(IsPositionOnBoard(position));
 
-      if (board->enPassant != XX)
+      if (PositionToRank[position] != RANK_2 && board->pieces[position - 10] == EMPTY)
       {
-        if (position - 9 == board->enPassant)
-        {
-          AddEnPassantMove(board, GenerateMoveKey(position, position - 9, EMPTY, EMPTY, FLAG_EN_PASSANT), list);
-        }
-
-        if (position - 11 == board->enPassant)
+        AddQuietMove(board, GenerateMoveKey(position, position - 10, EMPTY, EMPTY, FLAG_EMPTY), list);
+        if (PositionToRank[position] == RANK_7 && board->pieces[position - 20] == EMPTY)
         {
-          AddEnPassantMove(board, GenerateMoveKey(position, position - 11, EMPTY, EMPTY, FLAG_EN_PASSANT), list);
+          AddQuietMove(board, GenerateMoveKey(position, position - 20, EMPTY, EMPTY, FLAG_PAWN_START), list);
         }
       }
     }
 
-    // Black castling
     if (board->castle & CASTLE_BLACK_KING)
     {
       int isPathCleared = board->pieces[F8] == EMPTY && board->pieces[G8] == EMPTY;
-      int isPositionSafe = !IsPositionAttacked(E8, WHITE, board) && !IsPositionAttacked(F8, WHITE, board);
-      if (isPathCleared && isPositionSafe)
+      if (isPathCleared && !IsPositionAttacked(E8, WHITE, board) && !IsPositionAttacked(F8, WHITE, board))
       {
         AddQuietMove(board, GenerateMoveKey(E8, G8, EMPTY, EMPTY, FLAG_CASTLE), list);
       }
@@ -875,15 +2343,14 @@ void GenerateAllMoves(const Board *board, MoveList *list)
     if (board->castle & CASTLE_BLACK_QUEEN)
     {
       int isPathCleared = board->pieces[D8] == EMPTY && board->pieces[C8] == EMPTY && board->pieces[B8] == EMPTY;
-      int isPositionSafe = !IsPositionAttacked(E8, WHITE, board) && !IsPositionAttacked(D8, WHITE, board);
-      if (isPathCleared && isPositionSafe)
+      if (isPathCleared && !IsPositionAttacked(E8, WHITE, board) && !IsPositionAttacked(D8, WHITE, board))
       {
         AddQuietMove(board, GenerateMoveKey(E8, C8, EMPTY, EMPTY, FLAG_CASTLE), list);
       }
     }
   }
 
-  // Generate slide piece moves
+  // Generate slide piece quiet moves
   pieceIndex = LoopSlideIndex[board->side];
   piece = SlidePieceIterator[pieceIndex++];
   while (piece != EMPTY)
@@ -895,31 +2362,18 @@ void GenerateAllMoves(const Board *board, MoveList *list)
       position = board->pieceList[piece][i];
       ASSERT(IsPositionOnBoard(position));
 
-      for (int j = 0; j < MoveDirectionCounts[piece]; ++j)
+      attacks = GetPieceAttacks(piece, GetIndexFromPosition(position), board->occupancy[BOTH]) & empty;
+      while (attacks)
       {
-        direction = MoveDirections[piece][j];
-        target = position + direction;
-
-        while (IsPositionOnBoard(target))
-        {
-          if (board->pieces[target] != EMPTY)
-          {
-            if (PieceColors[board->pieces[target]] == (board->side ^ 1))
-            {
-              AddCaptureMove(board, GenerateMoveKey(position, target, board->pieces[target], EMPTY, FLAG_EMPTY), list);
-            }
-            break;
-          }
-          AddQuietMove(board, GenerateMoveKey(position, target, EMPTY, EMPTY, FLAG_EMPTY), list);
-          target += direction;
-        }
+        target = GetPositionFromIndex(PopBit(&attacks));
+        AddQuietMove(board, GenerateMoveKey(position, target, EMPTY, EMPTY, FLAG_EMPTY), list);
       }
     }
 
     piece = SlidePieceIterator[pieceIndex++];
   }
 
-  // Generate non-slide piece moves
+  // Generate non-slide piece quiet moves
   pieceIndex = LoopNonSlideIndex[board->side];
   piece = NonSlidePieceIterator[pieceIndex++];
   while (piece != EMPTY)
@@ -931,23 +2385,11 @@ void GenerateAllMoves(const Board *board, MoveList *list)
       position = board->pieceList[piece][i];
       ASSERT(IsPositionOnBoard(position));
 
-      for (int j = 0; j < MoveDirectionCounts[piece]; ++j)
+      attacks = KnightPieces[piece] ? KnightAttacks[GetIndexFromPosition(position)] : KingAttacks[GetIndexFromPosition(position)];
+      attacks &= empty;
+      while (attacks)
       {
-        direction = MoveDirections[piece][j];
-        target = position + direction;
-
-        if (!IsPositionOnBoard(target))
-        {
-          continue;
-        }
-        if (board->pieces[target] != EMPTY)
-        {
-          if (PieceColors[board->pieces[target]] == (board->side ^ 1))
-          {
-            AddCaptureMove(board, GenerateMoveKey(position, target, board->pieces[target], EMPTY, FLAG_EMPTY), list);
-          }
-          continue;
-        }
+        target = GetPositionFromIndex(PopBit(&attacks));
         AddQuietMove(board, GenerateMoveKey(position, target, EMPTY, EMPTY, FLAG_EMPTY), list);
       }
     }
@@ -956,760 +2398,3662 @@ void GenerateAllMoves(const Board *board, MoveList *list)
   }
 }
 
-// Clear piece
-void ClearPiece(const int position, Board *board)
+// Generate all moves to move list, captures and promotions first
+void GenerateAllMoves(const Board *board, MoveList *list)
 {
-  ASSERT(IsPositionOnBoard(position));
-
-  int piece = board->pieces[position];
-  ASSERT(IsPieceValidWithoutEmpty(piece));
+  MoveList quiets[1];
 
-  HashPiece(board, piece, position);
+  GenerateAllCaptures(board, list);
+  GenerateAllQuiets(board, quiets);
+  for (int i = 0; i < quiets->count; ++i)
+  {
+    list->moves[list->count] = quiets->moves[i];
+    list->scores[list->count++] = quiets->scores[i];
+  }
+}
 
-  int color = PieceColors[piece];
-  board->pieces[position] = EMPTY;
-  board->materials[color] -= PieceValues[piece];
+// Check whether a move, such as one from the hash table, is pseudo-legal in the position
+int IsMovePseudoLegal(const Board *board, int move)
+{
+  int from = GetFromPositionFromMoveKey(move);
+  int to = GetToPositionFromMoveKey(move);
+  int capture = GetCaptureFromMoveKey(move);
+  int promotion = GetPromotionFromMoveKey(move);
 
-  if (BigPieces[piece])
+  if (move == NO_MOVE || !IsPositionOnBoard(from) || !IsPositionOnBoard(to))
   {
-    board->bigPieces[color]--;
-    if (MajorPieces[piece])
-    {
-      board->majorPieces[color]--;
-    }
-    else
-    {
-      board->minorPieces[color]--;
-    }
+    return FALSE;
   }
-  else
+
+  int piece = board->pieces[from];
+  if (piece == EMPTY || PieceColors[piece] != board->side)
   {
-    ClearBit(&board->pawns[color], GetIndexFromPosition(position));
-    ClearBit(&board->pawns[BOTH], GetIndexFromPosition(position));
+    return FALSE;
   }
 
-  int target = -1;
-  for (int i = 0; i < board->counts[piece]; ++i)
+  // Castling checks path and attacks, so compare against the generated moves
+  if (move & FLAG_CASTLE)
   {
-    if (board->pieceList[piece][i] == position)
+    MoveList list[1];
+    GenerateAllQuiets(board, list);
+    for (int i = 0; i < list->count; ++i)
     {
-      target = i;
-      break;
+      if (list->moves[i] == GetCompactFromMoveKey(move))
+      {
+        return TRUE;
+      }
     }
+    return FALSE;
   }
-  ASSERT(target != -1);
-
-  board->counts[piece]--;
-  board->pieceList[piece][target] = board->pieceList[piece][board->counts[piece]];
-}
-
-// Add piece
-void AddPiece(const int position, Board *board, int piece)
-{
-  ASSERT(IsPositionOnBoard(position));
-  ASSERT(IsPieceValidWithoutEmpty(piece));
 
-  int color = PieceColors[piece];
+  if (move & FLAG_EN_PASSANT)
+  {
+    return to == board->enPassant && capture == EMPTY && promotion == EMPTY && piece == (board->side == WHITE ? WHITE_PAWN : BLACK_PAWN)
+      && (PawnAttacks[board->side][GetIndexFromPosition(from)] & SetMask[GetIndexFromPosition(to)]);
+  }
 
-  HashPiece(board, piece, position);
-  board->pieces[position] = piece;
+  if (board->pieces[to] != capture || (capture != EMPTY && PieceColors[capture] == board->side))
+  {
+    return FALSE;
+  }
 
-  if (BigPieces[piece])
+  // Pawn pushes, double pushes, captures and promotions
+  if (piece == WHITE_PAWN || piece == BLACK_PAWN)
   {
-    board->bigPieces[color]++;
-    if (MajorPieces[piece])
+    int forward = board->side == WHITE ? 10 : -10;
+    int lastRank = board->side == WHITE ? RANK_8 : RANK_1;
+
+    if ((PositionToRank[to] == lastRank) != (promotion != EMPTY))
     {
-      board->majorPieces[color]++;
+      return FALSE;
     }
-    else
+    if (promotion != EMPTY && (PieceColors[promotion] != board->side || promotion == piece || KingPieces[promotion]))
     {
-      board->minorPieces[color]++;
+      return FALSE;
+    }
+    if (move & FLAG_PAWN_START)
+    {
+      return capture == EMPTY && PositionToRank[from] == (board->side == WHITE ? RANK_2 : RANK_7)
+        && to == from + 2 * forward && board->pieces[from + forward] == EMPTY;
+    }
+    if (capture == EMPTY)
+    {
+      return to == from + forward;
     }
+    return (PawnAttacks[board->side][GetIndexFromPosition(from)] & SetMask[GetIndexFromPosition(to)]) != 0ULL;
   }
-  else
+
+  if (promotion != EMPTY || (move & FLAG_PAWN_START))
   {
-    SetBit(&board->pawns[color], GetIndexFromPosition(position));
-    SetBit(&board->pawns[BOTH], GetIndexFromPosition(position));
+    return FALSE;
   }
+  return (GetPieceAttacks(piece, GetIndexFromPosition(from), board->occupancy[BOTH]) & SetMask[GetIndexFromPosition(to)]) != 0ULL;
+}
 
-  board->materials[color] += PieceValues[piece];
-  board->pieceList[piece][board->counts[piece]++] = position;
+// Get pinned pieces of the side to move
+u64 GetPinnedPieces(const Board *board)
+{
+  int side = board->side;
+  int king = GetIndexFromPosition(board->kingSquares[side]);
+  u64 us = board->occupancy[side];
+  u64 them = board->occupancy[side ^ 1];
+  u64 enemyBishopsOrQueens = board->bitboards[side == WHITE ? BLACK_BISHOP : WHITE_BISHOP] | board->bitboards[side == WHITE ? BLACK_QUEEN : WHITE_QUEEN];
+  u64 enemyRooksOrQueens = board->bitboards[side == WHITE ? BLACK_ROOK : WHITE_ROOK] | board->bitboards[side == WHITE ? BLACK_QUEEN : WHITE_QUEEN];
+  u64 snipers = (GetBishopAttacks(king, them) & enemyBishopsOrQueens) | (GetRookAttacks(king, them) & enemyRooksOrQueens);
+  u64 pinned = 0ULL;
+
+  while (snipers)
+  {
+    u64 blockers = BetweenMask[king][PopBit(&snipers)] & board->occupancy[BOTH];
+    if (blockers && !(blockers & (blockers - 1)) && (blockers & us))
+    {
+      pinned |= blockers;
+    }
+  }
+  return pinned;
 }
 
-// Move piece
-void MovePiece(const int from, const int to, Board *board)
+// Get positions a non-king move must reach to resolve a single check
+u64 GetCheckMask(const int king, const u64 checkers)
 {
-  ASSERT(IsPositionOnBoard(from));
-  ASSERT(IsPositionOnBoard(to));
+  u64 checker = checkers;
 
-  int piece = board->pieces[from];
-  int color = PieceColors[piece];
-#ifdef DEBUG
-  int pieceNum = FALSE;
-#endif
+  if (checkers == 0ULL)
+  {
+    return ~0ULL;
+  }
+  return checkers | BetweenMask[king][PopBit(&checker)];
+}
 
-  HashPiece(board, EMPTY, from);
-  board->pieces[from] = EMPTY;
-  HashPiece(board, piece, to);
-  board->pieces[to] = piece;
+// Check whether the king of the side to move can step to index
+int IsKingStepLegal(const Board *board, const int index)
+{
+  int side = board->side;
+  u64 occupancy = board->occupancy[BOTH] ^ board->bitboards[side == WHITE ? WHITE_KING : BLACK_KING];
 
-  if (!BigPieces[piece])
+  return (GetAttackers(board, index, occupancy) & board->occupancy[side ^ 1]) == 0ULL;
+}
+
+// Check whether en passant from position is legal, replaying the capture to catch discovered checks
+int IsEnPassantLegal(const Board *board, const int position, const u64 checkMask)
+{
+  int side = board->side;
+  int king = GetIndexFromPosition(board->kingSquares[side]);
+  int target = GetIndexFromPosition(board->enPassant);
+  int captured = GetIndexFromPosition(board->enPassant + (side == WHITE ? -10 : 10));
+  u64 occupancy = (board->occupancy[BOTH] ^ SetMask[GetIndexFromPosition(position)] ^ SetMask[captured]) | SetMask[target];
+  u64 enemyBishopsOrQueens = board->bitboards[side == WHITE ? BLACK_BISHOP : WHITE_BISHOP] | board->bitboards[side == WHITE ? BLACK_QUEEN : WHITE_QUEEN];
+  u64 enemyRooksOrQueens = board->bitboards[side == WHITE ? BLACK_ROOK : WHITE_ROOK] | board->bitboards[side == WHITE ? BLACK_QUEEN : WHITE_QUEEN];
+
+  if (!(checkMask & (SetMask[target] | SetMask[captured])))
   {
-    ClearBit(&board->pawns[color], GetIndexFromPosition(from));
-    ClearBit(&board->pawns[BOTH], GetIndexFromPosition(from));
-    SetBit(&board->pawns[color], GetIndexFromPosition(to));
-    SetBit(&board->pawns[BOTH], GetIndexFromPosition(to));
+    return FALSE;
   }
-
-  for (int i = 0; i < board->counts[piece]; ++i)
+  if ((GetBishopAttacks(king, occupancy) & enemyBishopsOrQueens) || (GetRookAttacks(king, occupancy) & enemyRooksOrQueens))
   {
-    if (board->pieceList[piece][i] == from)
-    {
-      board->pieceList[piece][i] = to;
-#ifdef DEBUG
-      pieceNum = TRUE;
-#endif
-      break;
-    }
+    return FALSE;
   }
-  ASSERT(pieceNum);
+  return TRUE;
 }
 
-// Take move
-void TakeMove(Board *board)
+// Check whether castle is legal for a side not in check, with every position the king crosses safe
+int IsCastleLegal(const Board *board, const int castle)
 {
-  // Check input valid
-  ASSERT(CheckBoard(board));
+  if (!(board->castle & castle))
+  {
+    return FALSE;
+  }
 
-  // Decrement ply
-  board->historyPly--;
-  board->currentPly--;
+  switch (castle)
+  {
+  case CASTLE_WHITE_KING:
+    return board->pieces[F1] == EMPTY && board->pieces[G1] == EMPTY && !IsPositionAttacked(F1, BLACK, board) && !IsPositionAttacked(G1, BLACK, board);
+  case CASTLE_WHITE_QUEEN:
+    return board->pieces[D1] == EMPTY && board->pieces[C1] == EMPTY && board->pieces[B1] == EMPTY && !IsPositionAttacked(D1, BLACK, board) && !IsPositionAttacked(C1, BLACK, board);
+  case CASTLE_BLACK_KING:
+    return board->pieces[F8] == EMPTY && board->pieces[G8] == EMPTY && !IsPositionAttacked(F8, WHITE, board) && !IsPositionAttacked(G8, WHITE, board);
+  case CASTLE_BLACK_QUEEN:
+    return board->pieces[D8] == EMPTY && board->pieces[C8] == EMPTY && board->pieces[B8] == EMPTY && !IsPositionAttacked(D8, WHITE, board) && !IsPositionAttacked(C8, WHITE, board);
+  default:
+    ASSERT(FALSE);
+  }
+  return FALSE;
+}
 
-  // Get latest move in history
-  int move = board->history[board->historyPly].move;
-  int from = GetFromPositionFromMoveKey(move);
-  int to = GetToPositionFromMoveKey(move);
+// Generate legal moves to move list
+void GenerateLegalMoves(const Board *board, MoveList *list)
+{
+  // Setup
+  int side = board->side;
+  int king = GetIndexFromPosition(board->kingSquares[side]);
+  int forward = side == WHITE ? 10 : -10;
+  int position = EMPTY;
+  int target = EMPTY;
+  int index = 0;
+  int piece = EMPTY;
+  u64 us = board->occupancy[side];
+  u64 them = board->occupancy[side ^ 1];
+  u64 checkers = GetAttackers(board, king, board->occupancy[BOTH]) & them;
+  u64 checkMask = 0ULL;
+  u64 pinned = 0ULL;
+  u64 attacks = 0ULL;
+  u64 allowed = 0ULL;
 
-  ASSERT(IsPositionOnBoard(from));
-  ASSERT(IsPositionOnBoard(to));
+  ASSERT(CheckBoard(board));
+  list->count = 0;
 
-  // Reverse move
-  if (board->enPassant != XX)
+  // King moves
+  attacks = KingAttacks[king] & ~us;
+  while (attacks)
   {
-    HashEnPassant(board);
+    index = PopBit(&attacks);
+    if (IsKingStepLegal(board, index))
+    {
+      target = GetPositionFromIndex(index);
+      if (board->pieces[target] != EMPTY)
+      {
+        AddCaptureMove(board, GenerateMoveKey(board->kingSquares[side], target, board->pieces[target], EMPTY, FLAG_EMPTY), list);
+      }
+      else
+      {
+        AddQuietMove(board, GenerateMoveKey(board->kingSquares[side], target, EMPTY, EMPTY, FLAG_EMPTY), list);
+      }
+    }
   }
-  HashCastle(board);
-
-  board->castle = board->history[board->historyPly].castle;
-  board->fiftyMoves = board->history[board->historyPly].fiftyMoves;
-  board->enPassant = board->history[board->historyPly].enPassant;
 
-  if (board->enPassant != XX)
+  // Only king moves can escape a double check
+  if (checkers & (checkers - 1))
   {
-    HashEnPassant(board);
+    return;
   }
-  HashCastle(board);
+  checkMask = GetCheckMask(king, checkers);
+  pinned = GetPinnedPieces(board);
 
-  board->side ^= 1;
-  HashSide(board);
-
-  if (move & FLAG_EN_PASSANT)
+  // Pawns
+  piece = side == WHITE ? WHITE_PAWN : BLACK_PAWN;
+  for (int i = 0; i < board->counts[piece]; ++i)
   {
-    if (board->side == WHITE)
+    position = board->pieceList[piece][i];
+    index = GetIndexFromPosition(position);
+    allowed = (pinned & SetMask[index]) ? checkMask & LineMask[king][index] : checkMask;
+
+    target = position + forward;
+    if (board->pieces[target] == EMPTY)
     {
-      AddPiece(to - 10, board, BLACK_PAWN);
+      if (allowed & SetMask[GetIndexFromPosition(target)])
+      {
+        if (side == WHITE)
+        {
+          AddWhitePawnQuietMove(board, position, target, list);
+        }
+        else
+        {
+          AddBlackPawnQuietMove(board, position, target, list);
+        }
+      }
+
+      int isStart = PositionToRank[position] == (side == WHITE ? RANK_2 : RANK_7);
+      if (isStart && board->pieces[target + forward] == EMPTY && (allowed & SetMask[GetIndexFromPosition(target + forward)]))
+      {
+        AddQuietMove(board, GenerateMoveKey(position, target + forward, EMPTY, EMPTY, FLAG_PAWN_START), list);
+      }
     }
-    else
+
+    attacks = PawnAttacks[side][index] & them & allowed;
+    while (attacks)
     {
-      AddPiece(to + 10, board, WHITE_PAWN);
+      target = GetPositionFromIndex(PopBit(&attacks));
+      if (side == WHITE)
+      {
+        AddWhitePawnCaptureMove(board, position, target, board->pieces[target], list);
+      }
+      else
+      {
+        AddBlackPawnCaptureMove(board, position, target, board->pieces[target], list);
+      }
     }
-  }
-  else if (move & FLAG_CASTLE)
-  {
-    switch (to)
+
+    if (board->enPassant != XX && (PawnAttacks[side][index] & SetMask[GetIndexFromPosition(board->enPassant)]))
     {
-    case C1:
-      MovePiece(D1, A1, board);
-      break;
-    case C8:
-      MovePiece(D8, A8, board);
-      break;
-    case G1:
-      MovePiece(F1, H1, board);
-      break;
-    case G8:
-      MovePiece(F8, H8, board);
-      break;
-    default:
-      ASSERT(FALSE);
+      if (IsEnPassantLegal(board, position, checkMask))
+      {
+        AddEnPassantMove(board, GenerateMoveKey(position, board->enPassant, EMPTY, EMPTY, FLAG_EN_PASSANT), list);
+      }
     }
   }
 
-  MovePiece(to, from, board);
-
-  if (KingPieces[board->pieces[from]])
+  // Knights, bishops, rooks and queens
+  for (piece = side == WHITE ? WHITE_KNIGHT : BLACK_KNIGHT; !KingPieces[piece]; ++piece)
   {
-    board->kingSquares[board->side] = from;
-  }
+    for (int i = 0; i < board->counts[piece]; ++i)
+    {
+      position = board->pieceList[piece][i];
+      index = GetIndexFromPosition(position);
+      allowed = (pinned & SetMask[index]) ? checkMask & LineMask[king][index] : checkMask;
 
-  int capture = GetCaptureFromMoveKey(move);
-  if (capture != EMPTY)
-  {
-    ASSERT(IsPieceValidWithoutEmpty(capture));
-    AddPiece(to, board, capture);
+      attacks = GetPieceAttacks(piece, index, board->occupancy[BOTH]) & ~us & allowed;
+      while (attacks)
+      {
+        target = GetPositionFromIndex(PopBit(&attacks));
+        if (board->pieces[target] != EMPTY)
+        {
+          AddCaptureMove(board, GenerateMoveKey(position, target, board->pieces[target], EMPTY, FLAG_EMPTY), list);
+          continue;
+        }
+        AddQuietMove(board, GenerateMoveKey(position, target, EMPTY, EMPTY, FLAG_EMPTY), list);
+      }
+    }
   }
 
-  int promote = GetPromotionFromMoveKey(move);
-  if (promote != EMPTY)
+  // Castling
+  if (checkers == 0ULL)
   {
-    ASSERT(IsPieceValidWithoutEmpty(promote) && BigPieces[promote]);
-    ClearPiece(from, board);
-    AddPiece(from, board, PieceColors[promote] == WHITE ? WHITE_PAWN : BLACK_PAWN);
+    if (side == WHITE)
+    {
+      if (IsCastleLegal(board, CASTLE_WHITE_KING))
+      {
+        AddQuietMove(board, GenerateMoveKey(E1, G1, EMPTY, EMPTY, FLAG_CASTLE), list);
+      }
+      if (IsCastleLegal(board, CASTLE_WHITE_QUEEN))
+      {
+        AddQuietMove(board, GenerateMoveKey(E1, C1, EMPTY, EMPTY, FLAG_CASTLE), list);
+      }
+    }
+    else
+    {
+      if (IsCastleLegal(board, CASTLE_BLACK_KING))
+      {
+        AddQuietMove(board, GenerateMoveKey(E8, G8, EMPTY, EMPTY, FLAG_CASTLE), list);
+      }
+      if (IsCastleLegal(board, CASTLE_BLACK_QUEEN))
+      {
+        AddQuietMove(board, GenerateMoveKey(E8, C8, EMPTY, EMPTY, FLAG_CASTLE), list);
+      }
+    }
   }
-
-  // Finalize
-  ASSERT(CheckBoard(board));
 }
 
-// Make move
-int MakeMove(Board *board, int move)
+// Count legal moves without generating them
+int CountLegalMoves(const Board *board)
 {
-  // Check input valid
-  ASSERT(CheckBoard(board));
-
-  int from = GetFromPositionFromMoveKey(move);
-  int to = GetToPositionFromMoveKey(move);
+  // Setup
   int side = board->side;
+  int king = GetIndexFromPosition(board->kingSquares[side]);
+  int forward = side == WHITE ? 10 : -10;
+  int position = EMPTY;
+  int target = EMPTY;
+  int index = 0;
+  int piece = EMPTY;
+  int count = 0;
+  u64 us = board->occupancy[side];
+  u64 them = board->occupancy[side ^ 1];
+  u64 checkers = GetAttackers(board, king, board->occupancy[BOTH]) & them;
+  u64 checkMask = 0ULL;
+  u64 pinned = 0ULL;
+  u64 attacks = 0ULL;
+  u64 allowed = 0ULL;
 
-  ASSERT(IsPositionOnBoard(from));
-  ASSERT(IsPositionOnBoard(to));
-  ASSERT(IsSideValid(side));
-  ASSERT(IsPieceValidWithoutEmpty(board->pieces[from]));
-
-  // Save position key to history
-  board->history[board->historyPly].positionKey = board->positionKey;
+  ASSERT(CheckBoard(board));
 
-  // Special moves
-  if (move & FLAG_EN_PASSANT)
-  {
-    ClearPiece(to + (side == WHITE ? -10 : 10), board);
-  }
-  else if (move & FLAG_CASTLE)
+  // King moves
+  attacks = KingAttacks[king] & ~us;
+  while (attacks)
   {
-    switch (to)
-    {
-    case C1:
-      MovePiece(A1, D1, board);
-      break;
-    case C8:
-      MovePiece(A8, D8, board);
-      break;
-    case G1:
-      MovePiece(H1, F1, board);
-      break;
-    case G8:
-      MovePiece(H8, F8, board);
-      break;
-    default:
-      ASSERT(FALSE);
-    }
+    count += IsKingStepLegal(board, PopBit(&attacks));
   }
 
-  // Update and hash
-  if (board->enPassant != XX)
+  // Only king moves can escape a double check
+  if (checkers & (checkers - 1))
   {
-    HashEnPassant(board);
+    return count;
   }
-  HashCastle(board);
-
-  board->history[board->historyPly].move = move;
-  board->history[board->historyPly].fiftyMoves = board->fiftyMoves;
-  board->history[board->historyPly].enPassant = board->enPassant;
-  board->history[board->historyPly].castle = board->castle;
-
-  board->castle &= CastlePermissions[from];
-  board->castle &= CastlePermissions[to];
-  board->enPassant = XX;
-
-  HashCastle(board);
-
-  // Fifty moves check
-  int capture = GetCaptureFromMoveKey(move);
-  board->fiftyMoves++;
+  checkMask = GetCheckMask(king, checkers);
+  pinned = GetPinnedPieces(board);
 
-  if (capture != EMPTY)
+  // Pawns, with each promotion counting once per promoted piece
+  piece = side == WHITE ? WHITE_PAWN : BLACK_PAWN;
+  for (int i = 0; i < board->counts[piece]; ++i)
   {
-    ASSERT(IsPieceValidWithoutEmpty(capture));
-    ClearPiece(to, board);
-    board->fiftyMoves = 0;
-  }
-
-  // Increment ply
-  board->historyPly++;
-  board->currentPly++;
+    position = board->pieceList[piece][i];
+    index = GetIndexFromPosition(position);
+    allowed = (pinned & SetMask[index]) ? checkMask & LineMask[king][index] : checkMask;
+    int moves = PositionToRank[position] == (side == WHITE ? RANK_7 : RANK_2) ? 4 : 1;
 
-  // Set new en passant position
-  if (!BigPieces[board->pieces[from]])
-  {
-    board->fiftyMoves = 0;
-    if (move & FLAG_PAWN_START)
+    target = position + forward;
+    if (board->pieces[target] == EMPTY)
     {
-      if (side == WHITE)
+      if (allowed & SetMask[GetIndexFromPosition(target)])
       {
-        board->enPassant = from + 10;
-        ASSERT(PositionToRank[board->enPassant] == RANK_3);
+        count += moves;
       }
-      else
+
+      int isStart = PositionToRank[position] == (side == WHITE ? RANK_2 : RANK_7);
+      if (isStart && board->pieces[target + forward] == EMPTY && (allowed & SetMask[GetIndexFromPosition(target + forward)]))
       {
-        board->enPassant = from - 10;
-        ASSERT(PositionToRank[board->enPassant] == RANK_6);
+        count++;
       }
-      HashEnPassant(board);
     }
-  }
 
-  // Move piece
-  MovePiece(from, to, board);
+    count += CountBit(PawnAttacks[side][index] & them & allowed) * moves;
 
-  // Promotion
-  int promote = GetPromotionFromMoveKey(move);
-  if (promote != EMPTY)
-  {
-    ASSERT(IsPieceValidWithoutEmpty(promote) && BigPieces[promote]);
-    ClearPiece(to, board);
-    AddPiece(to, board, promote);
+    if (board->enPassant != XX && (PawnAttacks[side][index] & SetMask[GetIndexFromPosition(board->enPassant)]))
+    {
+      count += IsEnPassantLegal(board, position, checkMask);
+    }
   }
 
-  // Update king position
-  if (KingPieces[board->pieces[to]])
+  // Knights, bishops, rooks and queens
+  for (piece = side == WHITE ? WHITE_KNIGHT : BLACK_KNIGHT; !KingPieces[piece]; ++piece)
   {
-    board->kingSquares[side] = to;
+    for (int i = 0; i < board->counts[piece]; ++i)
+    {
+      index = GetIndexFromPosition(board->pieceList[piece][i]);
+      allowed = (pinned & SetMask[index]) ? checkMask & LineMask[king][index] : checkMask;
+      count += CountBit(GetPieceAttacks(piece, index, board->occupancy[BOTH]) & ~us & allowed);
+    }
   }
 
-  // Change side
-  board->side ^= 1;
-  HashSide(board);
-
-  // Finalize
-  ASSERT(CheckBoard(board));
-  if (IsPositionAttacked(board->kingSquares[side], board->side, board))
+  // Castling
+  if (checkers == 0ULL)
   {
-    TakeMove(board);
-    return FALSE;
+    if (side == WHITE)
+    {
+      count += IsCastleLegal(board, CASTLE_WHITE_KING) + IsCastleLegal(board, CASTLE_WHITE_QUEEN);
+    }
+    else
+    {
+      count += IsCastleLegal(board, CASTLE_BLACK_KING) + IsCastleLegal(board, CASTLE_BLACK_QUEEN);
+    }
   }
-  return TRUE;
-}
 
-//// Material ////
+  return count;
+}
+
+// Clear piece
+void ClearPiece(const int position, Board *board)
+{
+  ASSERT(IsPositionOnBoard(position));
+
+  int piece = board->pieces[position];
+  ASSERT(IsPieceValidWithoutEmpty(piece));
+
+  HashPiece(board, piece, position);
+
+  int color = PieceColors[piece];
+  int index = GetIndexFromPosition(position);
+  if (NnueLoaded && !KingPieces[piece])
+  {
+    NnueClearPiece(board, piece, index);
+  }
+  board->pieces[position] = EMPTY;
+  board->materials[color] -= PieceValues[piece];
+  board->middlegameScores[color] -= MiddlegamePieceSquare[piece][index];
+  board->endgameScores[color] -= EndgamePieceSquare[piece][index];
+
+  ClearBit(&board->bitboards[piece], index);
+  ClearBit(&board->occupancy[color], index);
+  ClearBit(&board->occupancy[BOTH], index);
+
+  if (BigPieces[piece])
+  {
+    board->bigPieces[color]--;
+    if (MajorPieces[piece])
+    {
+      board->majorPieces[color]--;
+    }
+    else
+    {
+      board->minorPieces[color]--;
+    }
+  }
+  else
+  {
+    ClearBit(&board->pawns[color], index);
+    ClearBit(&board->pawns[BOTH], index);
+  }
+
+  int target = -1;
+  for (int i = 0; i < board->counts[piece]; ++i)
+  {
+    if (board->pieceList[piece][i] == position)
+    {
+      target = i;
+      break;
+    }
+  }
+  ASSERT(target != -1);
+
+  board->counts[piece]--;
+  board->pieceList[piece][target] = board->pieceList[piece][board->counts[piece]];
+}
+
+// Add piece
+void AddPiece(const int position, Board *board, int piece)
+{
+  ASSERT(IsPositionOnBoard(position));
+  ASSERT(IsPieceValidWithoutEmpty(piece));
+
+  int color = PieceColors[piece];
+  int index = GetIndexFromPosition(position);
+
+  HashPiece(board, piece, position);
+  board->pieces[position] = piece;
+  if (NnueLoaded && !KingPieces[piece])
+  {
+    NnueAddPiece(board, piece, index);
+  }
+
+  SetBit(&board->bitboards[piece], index);
+  SetBit(&board->occupancy[color], index);
+  SetBit(&board->occupancy[BOTH], index);
+
+  if (BigPieces[piece])
+  {
+    board->bigPieces[color]++;
+    if (MajorPieces[piece])
+    {
+      board->majorPieces[color]++;
+    }
+    else
+    {
+      board->minorPieces[color]++;
+    }
+  }
+  else
+  {
+    SetBit(&board->pawns[color], index);
+    SetBit(&board->pawns[BOTH], index);
+  }
+
+  board->materials[color] += PieceValues[piece];
+  board->middlegameScores[color] += MiddlegamePieceSquare[piece][index];
+  board->endgameScores[color] += EndgamePieceSquare[piece][index];
+  board->pieceList[piece][board->counts[piece]++] = position;
+}
+
+// Move piece
+void MovePiece(const int from, const int to, Board *board)
+{
+  ASSERT(IsPositionOnBoard(from));
+  ASSERT(IsPositionOnBoard(to));
+
+  int piece = board->pieces[from];
+  int color = PieceColors[piece];
+  int fromIndex = GetIndexFromPosition(from);
+  int toIndex = GetIndexFromPosition(to);
+  u64 move = SetMask[fromIndex] | SetMask[toIndex];
+#ifdef DEBUG
+  int pieceNum = FALSE;
+#endif
+
+  HashPiece(board, piece, from);
+  board->pieces[from] = EMPTY;
+  HashPiece(board, piece, to);
+  board->pieces[to] = piece;
+
+  board->bitboards[piece] ^= move;
+  board->occupancy[color] ^= move;
+  board->occupancy[BOTH] ^= move;
+
+  if (NnueLoaded)
+  {
+    NnueMovePiece(board, piece, fromIndex, toIndex);
+  }
+
+  board->middlegameScores[color] += MiddlegamePieceSquare[piece][toIndex] - MiddlegamePieceSquare[piece][fromIndex];
+  board->endgameScores[color] += EndgamePieceSquare[piece][toIndex] - EndgamePieceSquare[piece][fromIndex];
+
+  if (!BigPieces[piece])
+  {
+    board->pawns[color] ^= move;
+    board->pawns[BOTH] ^= move;
+  }
+
+  for (int i = 0; i < board->counts[piece]; ++i)
+  {
+    if (board->pieceList[piece][i] == from)
+    {
+      board->pieceList[piece][i] = to;
+#ifdef DEBUG
+      pieceNum = TRUE;
+#endif
+      break;
+    }
+  }
+  ASSERT(pieceNum);
+}
+
+// Take move
+void TakeMove(Board *board)
+{
+  // Check input valid
+  ASSERT(CheckBoard(board));
+
+  // Copy-make restores the saved position instead of undoing the move
+  if (CopyMake)
+  {
+    RestoreSnapshot(board);
+    return;
+  }
+
+  // Decrement ply
+  board->historyPly--;
+  board->currentPly--;
+
+  // Get latest move in history
+  int move = board->history[board->historyPly].move;
+  int from = GetFromPositionFromMoveKey(move);
+  int to = GetToPositionFromMoveKey(move);
+
+  ASSERT(IsPositionOnBoard(from));
+  ASSERT(IsPositionOnBoard(to));
+
+  // Reverse move
+  if (board->enPassant != XX)
+  {
+    HashEnPassant(board);
+  }
+  HashCastle(board);
+
+  board->castle = board->history[board->historyPly].castle;
+  board->fiftyMoves = board->history[board->historyPly].fiftyMoves;
+  board->enPassant = board->history[board->historyPly].enPassant;
+
+  if (board->enPassant != XX)
+  {
+    HashEnPassant(board);
+  }
+  HashCastle(board);
+
+  board->side ^= 1;
+  HashSide(board);
+
+  if (move & FLAG_EN_PASSANT)
+  {
+    if (board->side == WHITE)
+    {
+      AddPiece(to - 10, board, BLACK_PAWN);
+    }
+    else
+    {
+      AddPiece(to + 10, board, WHITE_PAWN);
+    }
+  }
+  else if (move & FLAG_CASTLE)
+  {
+    switch (to)
+    {
+    case C1:
+      MovePiece(D1, A1, board);
+      break;
+    case C8:
+      MovePiece(D8, A8, board);
+      break;
+    case G1:
+      MovePiece(F1, H1, board);
+      break;
+    case G8:
+      MovePiece(F8, H8, board);
+      break;
+    default:
+      ASSERT(FALSE);
+    }
+  }
+
+  MovePiece(to, from, board);
+
+  if (KingPieces[board->pieces[from]])
+  {
+    board->kingSquares[board->side] = from;
+  }
+
+  int capture = GetCaptureFromMoveKey(move);
+  if (capture != EMPTY)
+  {
+    ASSERT(IsPieceValidWithoutEmpty(capture));
+    AddPiece(to, board, capture);
+  }
+
+  int promote = GetPromotionFromMoveKey(move);
+  if (promote != EMPTY)
+  {
+    ASSERT(IsPieceValidWithoutEmpty(promote) && BigPieces[promote]);
+    ClearPiece(from, board);
+    AddPiece(from, board, PieceColors[promote] == WHITE ? WHITE_PAWN : BLACK_PAWN);
+  }
+
+  // Restore the perspective left dirty by an undone king move, after every piece is back in place
+  if (NnueLoaded && KingPieces[board->pieces[from]])
+  {
+    RestoreKingPerspective(board, board->side);
+  }
+
+  // Finalize
+  ASSERT(CheckBoard(board));
+}
+
+// Make move known to be legal without verifying king safety
+void MakeLegalMove(Board *board, int move)
+{
+  // Check input valid
+  ASSERT(CheckBoard(board));
+
+  int from = GetFromPositionFromMoveKey(move);
+  int to = GetToPositionFromMoveKey(move);
+  int side = board->side;
+
+  ASSERT(IsPositionOnBoard(from));
+  ASSERT(IsPositionOnBoard(to));
+  ASSERT(IsSideValid(side));
+  ASSERT(IsPieceValidWithoutEmpty(board->pieces[from]));
+
+  // Save position key to history, growing it for long games
+  if (board->historyPly >= board->historyCapacity)
+  {
+    ReserveHistory(board, board->historyPly + 1);
+  }
+  if (CopyMake)
+  {
+    SaveSnapshot(board);
+  }
+  else if (NnueLoaded && KingPieces[board->pieces[from]])
+  {
+    SaveKingPerspective(board, side);
+  }
+  board->history[board->historyPly].positionKey = board->positionKey;
+
+  // Special moves
+  if (move & FLAG_EN_PASSANT)
+  {
+    ClearPiece(to + (side == WHITE ? -10 : 10), board);
+  }
+  else if (move & FLAG_CASTLE)
+  {
+    switch (to)
+    {
+    case C1:
+      MovePiece(A1, D1, board);
+      break;
+    case C8:
+      MovePiece(A8, D8, board);
+      break;
+    case G1:
+      MovePiece(H1, F1, board);
+      break;
+    case G8:
+      MovePiece(H8, F8, board);
+      break;
+    default:
+      ASSERT(FALSE);
+    }
+  }
+
+  // Update and hash
+  if (board->enPassant != XX)
+  {
+    HashEnPassant(board);
+  }
+  HashCastle(board);
+
+  board->history[board->historyPly].move = move;
+  board->history[board->historyPly].fiftyMoves = board->fiftyMoves;
+  board->history[board->historyPly].enPassant = board->enPassant;
+  board->history[board->historyPly].castle = board->castle;
+
+  board->castle &= CastlePermissions[from];
+  board->castle &= CastlePermissions[to];
+  board->enPassant = XX;
+
+  HashCastle(board);
+
+  // Fifty moves check
+  int capture = GetCaptureFromMoveKey(move);
+  board->fiftyMoves++;
+
+  if (capture != EMPTY)
+  {
+    ASSERT(IsPieceValidWithoutEmpty(capture));
+    ClearPiece(to, board);
+    board->fiftyMoves = 0;
+  }
+
+  // Increment ply
+  board->historyPly++;
+  board->currentPly++;
+
+  // Set new en passant position
+  if (!BigPieces[board->pieces[from]])
+  {
+    board->fiftyMoves = 0;
+    if (move & FLAG_PAWN_START)
+    {
+      int enPassant = side == WHITE ? from + 10 : from - 10;
+      ASSERT(PositionToRank[enPassant] == (side == WHITE ? RANK_3 : RANK_6));
+
+      // Only record en passant when an enemy pawn can capture, so transpositions share a key
+      if (PawnAttacks[side][GetIndexFromPosition(enPassant)] & board->bitboards[side == WHITE ? BLACK_PAWN : WHITE_PAWN])
+      {
+        board->enPassant = enPassant;
+        HashEnPassant(board);
+      }
+    }
+  }
+
+  // Move piece
+  MovePiece(from, to, board);
+
+  // Promotion
+  int promote = GetPromotionFromMoveKey(move);
+  if (promote != EMPTY)
+  {
+    ASSERT(IsPieceValidWithoutEmpty(promote) && BigPieces[promote]);
+    ClearPiece(to, board);
+    AddPiece(to, board, promote);
+  }
+
+  // Update king position
+  if (KingPieces[board->pieces[to]])
+  {
+    board->kingSquares[side] = to;
+  }
+
+  // Change side
+  board->side ^= 1;
+  HashSide(board);
+
+  // Finalize
+  ASSERT(CheckBoard(board));
+}
+
+// Make move
+int MakeMove(Board *board, int move)
+{
+  int side = board->side;
+
+  MakeLegalMove(board, move);
+  if (IsPositionAttacked(board->kingSquares[side], board->side, board))
+  {
+    TakeMove(board);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+//// Material ////
 
 // Update material
 void UpdateMaterial(Board *board)
 {
-  for (int i = 0; i < POSITION_SIZE; ++i)
+  for (int i = 0; i < POSITION_SIZE; ++i)
+  {
+    int piece = board->pieces[i];
+    if (piece != OB && piece != EMPTY)
+    {
+      int color = PieceColors[piece];
+
+      // Piece type
+      if (BigPieces[piece])
+      {
+        board->bigPieces[color]++;
+      }
+      if (MajorPieces[piece])
+      {
+        board->majorPieces[color]++;
+      }
+      if (MinorPieces[piece])
+      {
+        board->minorPieces[color]++;
+      }
+
+      // Material and count
+      board->materials[color] += PieceValues[piece];
+      board->middlegameScores[color] += MiddlegamePieceSquare[piece][GetIndexFromPosition(i)];
+      board->endgameScores[color] += EndgamePieceSquare[piece][GetIndexFromPosition(i)];
+      SetBit(&board->bitboards[piece], GetIndexFromPosition(i));
+      SetBit(&board->occupancy[color], GetIndexFromPosition(i));
+      SetBit(&board->occupancy[BOTH], GetIndexFromPosition(i));
+      board->pieceList[piece][board->counts[piece]] = i;
+      board->counts[piece]++;
+
+      // Kings
+      if (piece == WHITE_KING)
+      {
+        board->kingSquares[WHITE] = i;
+      }
+      if (piece == BLACK_KING)
+      {
+        board->kingSquares[BLACK] = i;
+      }
+
+      // Pawns
+      if (piece == WHITE_PAWN)
+      {
+        SetBit(&board->pawns[WHITE], GetIndexFromPosition(i));
+        SetBit(&board->pawns[BOTH], GetIndexFromPosition(i));
+      }
+      if (piece == BLACK_PAWN)
+      {
+        SetBit(&board->pawns[BLACK], GetIndexFromPosition(i));
+        SetBit(&board->pawns[BOTH], GetIndexFromPosition(i));
+      }
+    }
+  }
+}
+
+//// Forsyth–Edwards Notation (FEN) ////
+
+// Parse FEN notation
+int ParseFen(char *fen, Board *board)
+{
+  ASSERT(fen != NULL);
+  ASSERT(board != NULL);
+
+  int rank = RANK_8;
+  int file = FILE_A;
+  int piece = 0;
+  int count = 0;
+
+  ResetBoard(board);
+
+  // Piece states
+  while (rank >= RANK_1 && *fen)
+  {
+    count = 1;
+    switch (*fen)
+    {
+    // Pieces
+    case 'p':
+      piece = BLACK_PAWN;
+      break;
+    case 'r':
+      piece = BLACK_ROOK;
+      break;
+    case 'n':
+      piece = BLACK_KNIGHT;
+      break;
+    case 'b':
+      piece = BLACK_BISHOP;
+      break;
+    case 'q':
+      piece = BLACK_QUEEN;
+      break;
+    case 'k':
+      piece = BLACK_KING;
+      break;
+    case 'P':
+      piece = WHITE_PAWN;
+      break;
+    case 'R':
+      piece = WHITE_ROOK;
+      break;
+    case 'N':
+      piece = WHITE_KNIGHT;
+      break;
+    case 'B':
+      piece = WHITE_BISHOP;
+      break;
+    case 'Q':
+      piece = WHITE_QUEEN;
+      break;
+    case 'K':
+      piece = WHITE_KING;
+      break;
+
+    // Empties
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+      piece = EMPTY;
+      count = *fen - '0';
+      break;
+
+    // New rank
+    case '/':
+    case ' ':
+      rank--;
+      file = FILE_A;
+      fen++;
+      continue;
+
+    // Default
+    default:
+      printf("FEN syntax error\n");
+      return -1;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+      int index = rank * 8 + file;
+      int position = GetPositionFromIndex(index);
+      if (piece != EMPTY)
+      {
+        board->pieces[position] = piece;
+      }
+      file++;
+    }
+    fen++;
+  }
+
+  // Side
+  ASSERT(*fen == 'w' || *fen == 'b');
+  board->side = *fen == 'w' ? WHITE : BLACK;
+  fen += 2;
+
+  // Castle
+  for (int i = 0; i < 4; ++i)
+  {
+    if (*fen == ' ')
+    {
+      break;
+    }
+
+    switch (*fen)
+    {
+    case 'K':
+      board->castle |= CASTLE_WHITE_KING;
+      break;
+    case 'Q':
+      board->castle |= CASTLE_WHITE_QUEEN;
+      break;
+    case 'k':
+      board->castle |= CASTLE_BLACK_KING;
+      break;
+    case 'q':
+      board->castle |= CASTLE_BLACK_QUEEN;
+      break;
+    }
+    fen++;
+  }
+  fen++;
+  ASSERT(board->castle >= 0 && board->castle < CASTLE_SIZE);
+
+  // En passant
+  if (*fen != '-')
+  {
+    file = fen[0] - 'a';
+    rank = fen[1] - '1';
+
+    ASSERT(file >= FILE_A && file <= FILE_H);
+    ASSERT(rank >= RANK_1 && rank <= RANK_8);
+    board->enPassant = GetPositionFromFileRank(file, rank);
+  }
+
+  // Fifty-move counter, when given
+  while (*fen != '\0' && *fen != ' ')
+  {
+    fen++;
+  }
+  board->fiftyMoves = *fen == ' ' ? atoi(fen + 1) : 0;
+
+  // Finalize
+  board->positionKey = GeneratePositionKey(board);
+  UpdateMaterial(board);
+  board->pawnKey = GeneratePawnKey(board);
+  return 0;
+}
+
+//// Print ////
+
+// Print move key in binary
+void PrintMoveKeyInBinary(int move)
+{
+  printf("Move key: ");
+  for (int i = 24; i >= 0; --i)
+  {
+    printf((1 << i) & move ? "1" : "0");
+    if (i == 24 || i == 20 || i == 19 || i == 18 || i == 14 || i == 7)
+    {
+      printf(" ");
+    }
+  }
+  printf("\n");
+}
+
+// Print position board
+void PrintPositionBoard()
+{
+  printf("Position board:\n");
+  for (int i = 0; i < POSITION_SIZE; ++i)
+  {
+    if (i % 10 == 0 && i > 0)
+    {
+      printf("\n");
+    }
+    printf("%5d", GetIndexFromPosition(i));
+  }
+}
+
+// Print index board
+void PrintIndexBoard()
+{
+  printf("Index board:\n");
+  for (int i = 0; i < INDEX_SIZE; ++i)
+  {
+    if (i % 8 == 0 && i > 0)
+    {
+      printf("\n");
+    }
+    printf("%5d", GetPositionFromIndex(i));
+  }
+}
+
+// Print bitboard
+void PrintBitboard(u64 key)
+{
+  int position = 0;
+  int index = 0;
+
+  printf("Bitboard:\n");
+  for (int rank = RANK_8; rank >= RANK_1; --rank)
+  {
+    for (int file = FILE_A; file <= FILE_H; ++file)
+    {
+      position = GetPositionFromFileRank(file, rank);
+      index = GetIndexFromPosition(position);
+      if (key & (1ULL << index))
+      {
+        printf(" X ");
+      }
+      else
+      {
+        printf(" - ");
+      }
+    }
+    printf("\n");
+  }
+}
+
+// Print attack board
+void PrintAttackBoard(const int side, const Board *board)
+{
+  int position = 0;
+
+  printf("Attack board:\n");
+  for (int rank = RANK_8; rank >= RANK_1; --rank)
+  {
+    for (int file = FILE_A; file <= FILE_H; ++file)
+    {
+      position = GetPositionFromFileRank(file, rank);
+      if (IsPositionAttacked(position, side, board))
+      {
+        printf(" X ");
+      }
+      else
+      {
+        printf(" - ");
+      }
+    }
+    printf("\n");
+  }
+}
+
+// Print board
+void PrintBoard(const Board *board)
+{
+  printf("Game board:\n\n");
+
+  // Board
+  for (int rank = RANK_8; rank >= RANK_1; --rank)
+  {
+    printf("%c ", RankCharacters[rank]);
+    for (int file = FILE_A; file <= FILE_H; ++file)
+    {
+      int index = rank * 8 + file;
+      int position = GetPositionFromIndex(index);
+      int piece = board->pieces[position];
+      printf("%3c", PieceCharacters[piece]);
+    }
+    printf("\n");
+  }
+  printf("\n  ");
+  for (int file = FILE_A; file <= FILE_H; ++file)
+  {
+    printf("%3c", FileCharacters[file]);
+  }
+  printf("\n\n");
+
+  // Statistics
+  char castleWhiteKing = board->castle & CASTLE_WHITE_KING ? 'K' : '-';
+  char castleWhiteQueen = board->castle & CASTLE_WHITE_QUEEN ? 'Q' : '-';
+  char castleBlackKing = board->castle & CASTLE_BLACK_KING ? 'k' : '-';
+  char castleBlackQueen = board->castle & CASTLE_BLACK_QUEEN ? 'q' : '-';
+
+  printf("Side: %c\n", SideCharacters[board->side]);
+  printf("En passant: %d\n", board->enPassant);
+  printf("Castle: %c%c%c%c\n", castleWhiteKing, castleWhiteQueen, castleBlackKing, castleBlackQueen);
+  printf("Position key: %llX\n", board->positionKey);
+}
+
+// Print move list
+void PrintMoveList(const MoveList *moveList)
+{
+  int move = 0;
+  int score = 0;
+  printf("Move list:\n\n");
+
+  for (int i = 0; i < moveList->count; ++i)
+  {
+    move = moveList->moves[i];
+    score = moveList->scores[i];
+    printf("Move: %d > %s (score: %d)\n", i + 1, GetStringFromCompact(move), score);
+  }
+  printf("Total moves: %d\n", moveList->count);
+}
+
+//// Time ////
+
+// Get monotonic time in milliseconds
+long GetTimeMs()
+{
+#ifdef _WIN32
+  return (long)GetTickCount();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+// Set soft and hard time limits from the remaining clock time, or from a fixed move time, with negative times meaning none
+void SetTimeLimits(SearchInfo *info, long time, long increment, int movesToGo, long moveTime)
+{
+  info->timeSet = moveTime >= 0 || time >= 0;
+  info->fixedTime = moveTime >= 0;
+
+  // A fixed move time is spent as given
+  if (moveTime >= 0)
+  {
+    info->softStopTime = info->startTime + moveTime;
+    info->stopTime = info->startTime + moveTime;
+    return;
+  }
+  if (time < 0)
+  {
+    return;
+  }
+
+  // The soft limit is an even share of the clock plus most of the increment, the hard limit a multiple of it
+  long limit = time - TIME_MARGIN > 1 ? time - TIME_MARGIN : 1;
+  long soft = time / (movesToGo > 0 ? movesToGo : TIME_MOVES_TO_GO) + increment * 3 / 4;
+  long hard = soft * TIME_HARD_RATIO;
+
+  hard = hard < limit ? hard : limit;
+  soft = soft < hard ? soft : hard;
+  info->softStopTime = info->startTime + soft;
+  info->stopTime = info->startTime + hard;
+}
+
+// Check whether the next iteration is worth starting, extending the soft limit while the best move is unstable
+int CanStartIteration(const SearchInfo *info, u64 nodes, u64 iterationNodes, u64 previousNodes, int instability)
+{
+  if (!info->timeSet || info->fixedTime)
+  {
+    return TRUE;
+  }
+
+  long now = GetTimeMs();
+  long elapsed = now - info->startTime;
+  long soft = (info->softStopTime - info->startTime) * (100 + TIME_INSTABILITY_BONUS * instability) / 100;
+  long hard = info->stopTime - info->startTime;
+
+  if (elapsed >= (soft < hard ? soft : hard))
+  {
+    return FALSE;
+  }
+
+  // Predict the next iteration from the last branching factor and the node rate, and skip it when it cannot finish
+  u64 branching = previousNodes > 0 ? iterationNodes * 100 / previousNodes : TIME_DEFAULT_BRANCHING;
+  branching = branching < 100 ? 100 : branching;
+  u64 rate = nodes * 1000 / (u64)(elapsed > 0 ? elapsed : 1);
+  u64 predicted = rate > 0 ? iterationNodes * branching / 100 * 1000 / rate : 0;
+
+  return now + (long)predicted < info->stopTime;
+}
+
+//// Perft ////
+
+// Initialize perft table with size in megabytes
+void InitPerftTable(PerftTable *table, int megabytes)
+{
+  u64 buckets = 1ULL;
+  u64 bytes = (u64)megabytes << 20;
+
+  while (buckets * 2 * PERFT_BUCKET_SIZE * sizeof(PerftEntry) <= bytes)
+  {
+    buckets *= 2;
+  }
+  table->entries = calloc(buckets * PERFT_BUCKET_SIZE, sizeof(PerftEntry));
+  table->mask = table->entries != NULL ? buckets - 1 : 0ULL;
+}
+
+// Free perft table
+void FreePerftTable(PerftTable *table)
+{
+  free(table->entries);
+  table->entries = NULL;
+  table->mask = 0ULL;
+}
+
+// Probe perft table, returning whether leaf nodes were found
+int ProbePerftTable(const PerftTable *table, u64 key, int depth, u64 *nodes)
+{
+  const PerftEntry *bucket = &table->entries[(key & table->mask) * PERFT_BUCKET_SIZE];
+
+  for (int i = 0; i < PERFT_BUCKET_SIZE; ++i)
+  {
+    u64 data = bucket[i].data;
+    if ((bucket[i].key ^ data) == key && (int)(data >> 56) == depth)
+    {
+      *nodes = data & 0xffffffffffffffULL;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Store leaf nodes in perft table, keeping the deeper entry in the first slot
+void StorePerftTable(PerftTable *table, u64 key, int depth, u64 nodes)
+{
+  PerftEntry *bucket = &table->entries[(key & table->mask) * PERFT_BUCKET_SIZE];
+  PerftEntry *entry = &bucket[1];
+  u64 data = ((u64)depth << 56) | nodes;
+
+  ASSERT(nodes <= 0xffffffffffffffULL);
+
+  if (depth >= (int)(bucket[0].data >> 56))
+  {
+    entry = &bucket[0];
+  }
+  entry->key = key ^ data;
+  entry->data = data;
+}
+
+// Perft function
+u64 Perft(int depth, Board *board, PerftTable *table)
+{
+  ASSERT(CheckBoard(board));
+
+  if (depth == 0)
+  {
+    return 1ULL;
+  }
+
+  // Bulk count the last ply instead of making each leaf move
+  if (depth == 1)
+  {
+    return (u64)CountLegalMoves(board);
+  }
+
+  u64 nodes = 0ULL;
+  if (table != NULL && ProbePerftTable(table, board->positionKey, depth, &nodes))
+  {
+    return nodes;
+  }
+
+  MoveList list[1];
+  GenerateLegalMoves(board, list);
+
+  for (int i = 0; i < list->count; ++i)
+  {
+    MakeLegalMove(board, GetMoveKeyFromCompact(board, list->moves[i]));
+    nodes += Perft(depth - 1, board, table);
+    TakeMove(board);
+  }
+
+  if (table != NULL)
+  {
+    StorePerftTable(table, board->positionKey, depth, nodes);
+  }
+  return nodes;
+}
+
+// Perft worker thread
+void *PerftWorkerThread(void *arg)
+{
+  PerftWorker *worker = (PerftWorker *)arg;
+  Board *board = &worker->board;
+  int index = 0;
+
+  while ((index = atomic_fetch_add(worker->next, 1)) < worker->count)
+  {
+    PerftJob *job = &worker->jobs[index];
+
+    MakeLegalMove(board, job->root);
+    if (job->reply != NO_MOVE)
+    {
+      MakeLegalMove(board, job->reply);
+      job->nodes = Perft(worker->depth - 2, board, worker->table);
+      TakeMove(board);
+    }
+    else
+    {
+      job->nodes = Perft(worker->depth - 1, board, worker->table);
+    }
+    TakeMove(board);
+
+    worker->nodes += job->nodes;
+  }
+  return NULL;
+}
+
+// Perft testing function
+void PerftTest(int depth, Board *board, int threads, PerftTable *table)
+{
+  ASSERT(CheckBoard(board));
+  ASSERT(depth >= 1);
+  ASSERT(threads >= 1 && threads <= MAX_THREADS);
+
+  PrintBoard(board);
+  printf("Start perft test with depth %d on %d threads\n", depth, threads);
+  long start = GetTimeMs();
+
+  MoveList list[1];
+  GenerateLegalMoves(board, list);
+
+  // Split at the root, or below it when there are spare threads and enough depth
+  int count = 0;
+  PerftJob *jobs = malloc(sizeof(PerftJob) * MAX_CHOICES * MAX_CHOICES);
+  for (int i = 0; i < list->count; ++i)
+  {
+    if (threads > 1 && depth >= 3)
+    {
+      MoveList replies[1];
+      int root = GetMoveKeyFromCompact(board, list->moves[i]);
+      MakeLegalMove(board, root);
+      GenerateLegalMoves(board, replies);
+
+      for (int j = 0; j < replies->count; ++j)
+      {
+        jobs[count].root = root;
+        jobs[count].reply = GetMoveKeyFromCompact(board, replies->moves[j]);
+        jobs[count].nodes = 0ULL;
+        count++;
+      }
+      TakeMove(board);
+    }
+    else
+    {
+      jobs[count].root = GetMoveKeyFromCompact(board, list->moves[i]);
+      jobs[count].reply = NO_MOVE;
+      jobs[count].nodes = 0ULL;
+      count++;
+    }
+  }
+
+  // Run workers on private board copies
+  atomic_int next = 0;
+  PerftWorker *workers = malloc(sizeof(PerftWorker) * threads);
+  pthread_t handles[MAX_THREADS];
+  for (int i = 0; i < threads; ++i)
+  {
+    InitBoard(&workers[i].board);
+    CopyBoard(&workers[i].board, board);
+    workers[i].jobs = jobs;
+    workers[i].count = count;
+    workers[i].depth = depth;
+    workers[i].next = &next;
+    workers[i].table = table;
+    workers[i].nodes = 0ULL;
+  }
+  for (int i = 1; i < threads; ++i)
+  {
+    pthread_create(&handles[i], NULL, PerftWorkerThread, &workers[i]);
+  }
+  PerftWorkerThread(&workers[0]);
+  for (int i = 1; i < threads; ++i)
+  {
+    pthread_join(handles[i], NULL);
+  }
+
+  // Divide output per root move
+  u64 leafNodes = 0ULL;
+  int job = 0;
+  for (int i = 0; i < list->count; ++i)
+  {
+    u64 nodes = 0ULL;
+    while (job < count && jobs[job].root == GetMoveKeyFromCompact(board, list->moves[i]))
+    {
+      nodes += jobs[job++].nodes;
+    }
+    leafNodes += nodes;
+    printf("Move %d: %s with %llu nodes\n", i + 1, GetStringFromCompact(list->moves[i]), nodes);
+  }
+  for (int i = 0; i < threads; ++i)
+  {
+    printf("Thread %d visited %llu nodes\n", i, workers[i].nodes);
+    FreeBoard(&workers[i].board);
+  }
+  long time = GetTimeMs() - start;
+  printf("Perft test complete with %llu nodes visited in %ld ms (%llu nps)\n", leafNodes, time, leafNodes * 1000 / (time > 0 ? time : 1));
+
+  free(workers);
+  free(jobs);
+}
+
+// Load perft suite from EPD file with lines of FEN followed by ";D<depth> <nodes>" fields
+int LoadPerftSuite(const char *path, PerftSuiteEntry *entries, int maxDepth)
+{
+  FILE *file = fopen(path, "r");
+  char line[1024];
+  int count = 0;
+
+  if (file == NULL)
+  {
+    printf("Cannot open perft suite %s\n", path);
+    return -1;
+  }
+
+  while (count < MAX_SUITE_POSITIONS && fgets(line, sizeof(line), file))
+  {
+    PerftSuiteEntry *entry = &entries[count];
+    char *field = strtok(line, ";");
+    int length = 0;
+
+    // Position
+    while (*field == ' ' || *field == '\t')
+    {
+      field++;
+    }
+    length = (int)strlen(field);
+    while (length > 0 && (field[length - 1] == ' ' || field[length - 1] == '\t' || field[length - 1] == '\n' || field[length - 1] == '\r'))
+    {
+      field[--length] = '\0';
+    }
+    if (length == 0 || length >= MAX_FEN_LENGTH || field[0] == '#')
+    {
+      continue;
+    }
+    memset(entry, 0, sizeof(PerftSuiteEntry));
+    strcpy(entry->fen, field);
+
+    // Expected leaf nodes
+    while ((field = strtok(NULL, ";")) != NULL)
+    {
+      int depth = 0;
+      u64 nodes = 0ULL;
+      if (sscanf(field, " D%d %llu", &depth, &nodes) == 2 && depth >= 1 && depth <= maxDepth)
+      {
+        entry->expected[depth] = nodes;
+        entry->depth = depth > entry->depth ? depth : entry->depth;
+      }
+    }
+
+    if (entry->depth > 0)
+    {
+      count++;
+    }
+  }
+
+  fclose(file);
+  return count;
+}
+
+// Print perft suite entry
+void PrintPerftSuiteEntry(int index, const PerftSuiteEntry *entry)
+{
+  printf("Position %d: %s\n", index + 1, entry->fen);
+  for (int depth = 1; depth <= entry->depth; ++depth)
+  {
+    if (entry->expected[depth])
+    {
+      char *result = entry->results[depth] == entry->expected[depth] ? "ok" : "FAILED";
+      printf("  Depth %d: %llu nodes (expected %llu) %s\n", depth, entry->results[depth], entry->expected[depth], result);
+    }
+  }
+  printf("  %llu nodes in %ld ms (%llu nps) %s\n", entry->nodes, entry->time, entry->nodes * 1000 / (entry->time > 0 ? entry->time : 1), entry->passed ? "passed" : "FAILED");
+}
+
+// Perft suite worker thread
+void *PerftSuiteWorkerThread(void *arg)
+{
+  PerftSuiteWorker *worker = (PerftSuiteWorker *)arg;
+  int index = 0;
+
+  while ((index = atomic_fetch_add(worker->next, 1)) < worker->count)
+  {
+    PerftSuiteEntry *entry = &worker->entries[index];
+    long start = GetTimeMs();
+
+    entry->passed = ParseFen(entry->fen, &worker->board) == 0;
+    for (int depth = 1; entry->passed && depth <= entry->depth; ++depth)
+    {
+      if (entry->expected[depth])
+      {
+        entry->results[depth] = Perft(depth, &worker->board, worker->table);
+        entry->nodes += entry->results[depth];
+        entry->passed = entry->results[depth] == entry->expected[depth];
+      }
+    }
+    entry->time = GetTimeMs() - start;
+
+    pthread_mutex_lock(worker->lock);
+    PrintPerftSuiteEntry(index, entry);
+    pthread_mutex_unlock(worker->lock);
+  }
+  return NULL;
+}
+
+// Perft suite function, spreading positions over threads and returning the number of failed positions
+int PerftSuite(const char *path, int maxDepth, int threads, PerftTable *table)
+{
+  ASSERT(maxDepth >= 1 && maxDepth <= MAX_PERFT_DEPTH);
+  ASSERT(threads >= 1 && threads <= MAX_THREADS);
+
+  PerftSuiteEntry *entries = malloc(sizeof(PerftSuiteEntry) * MAX_SUITE_POSITIONS);
+  int count = LoadPerftSuite(path, entries, maxDepth);
+  if (count < 0)
+  {
+    free(entries);
+    return 1;
+  }
+  printf("Start perft suite with %d positions up to depth %d on %d threads\n", count, maxDepth, threads);
+  long start = GetTimeMs();
+
+  // Run workers
+  atomic_int next = 0;
+  pthread_mutex_t lock;
+  PerftSuiteWorker *workers = malloc(sizeof(PerftSuiteWorker) * threads);
+  pthread_t handles[MAX_THREADS];
+  pthread_mutex_init(&lock, NULL);
+  for (int i = 0; i < threads; ++i)
+  {
+    InitBoard(&workers[i].board);
+    workers[i].entries = entries;
+    workers[i].count = count;
+    workers[i].next = &next;
+    workers[i].table = table;
+    workers[i].lock = &lock;
+  }
+  for (int i = 1; i < threads; ++i)
+  {
+    pthread_create(&handles[i], NULL, PerftSuiteWorkerThread, &workers[i]);
+  }
+  PerftSuiteWorkerThread(&workers[0]);
+  for (int i = 1; i < threads; ++i)
+  {
+    pthread_join(handles[i], NULL);
+  }
+  pthread_mutex_destroy(&lock);
+  for (int i = 0; i < threads; ++i)
+  {
+    FreeBoard(&workers[i].board);
+  }
+
+  // Aggregate
+  int failed = 0;
+  u64 nodes = 0ULL;
+  for (int i = 0; i < count; ++i)
+  {
+    failed += !entries[i].passed;
+    nodes += entries[i].nodes;
+  }
+  long time = GetTimeMs() - start;
+  printf("Perft suite complete with %d of %d positions passed\n", count - failed, count);
+  printf("%llu nodes visited in %ld ms (%llu nps)\n", nodes, time, nodes * 1000 / (time > 0 ? time : 1));
+
+  free(workers);
+  free(entries);
+  return failed;
+}
+
+//// Static exchange ////
+
+// Get material gained by the piece captured with a move
+int GetCaptureValue(int move)
+{
+  if (move & FLAG_EN_PASSANT)
+  {
+    return PieceValues[WHITE_PAWN];
+  }
+  return PieceValues[GetCaptureFromMoveKey(move)];
+}
+
+// Get least valuable piece of a side among attackers, returning empty when there is none
+int GetLeastValuableAttacker(const Board *board, u64 attackers, int side, u64 *bit)
+{
+  int first = side == WHITE ? WHITE_PAWN : BLACK_PAWN;
+
+  for (int piece = first; piece < first + 6; ++piece)
+  {
+    u64 pieces = attackers & board->bitboards[piece];
+    if (pieces)
+    {
+      *bit = pieces & (~pieces + 1);
+      return piece;
+    }
+  }
+  return EMPTY;
+}
+
+// Static exchange evaluation of the capture sequence on the target of a move, from the side to move
+int SEE(const Board *board, int move)
+{
+  int from = GetIndexFromPosition(GetFromPositionFromMoveKey(move));
+  int to = GetIndexFromPosition(GetToPositionFromMoveKey(move));
+  int promotion = GetPromotionFromMoveKey(move);
+  int piece = promotion != EMPTY ? promotion : board->pieces[GetFromPositionFromMoveKey(move)];
+  int side = board->side ^ 1;
+  int gains[32];
+  int depth = 0;
+
+  u64 bishopsOrQueens = board->bitboards[WHITE_BISHOP] | board->bitboards[WHITE_QUEEN] | board->bitboards[BLACK_BISHOP] | board->bitboards[BLACK_QUEEN];
+  u64 rooksOrQueens = board->bitboards[WHITE_ROOK] | board->bitboards[WHITE_QUEEN] | board->bitboards[BLACK_ROOK] | board->bitboards[BLACK_QUEEN];
+  u64 occupancy = board->occupancy[BOTH] ^ SetMask[from];
+
+  ASSERT(CheckBoard(board));
+
+  gains[0] = GetCaptureValue(move);
+  if (promotion != EMPTY)
+  {
+    gains[0] += PieceValues[promotion] - PieceValues[WHITE_PAWN];
+  }
+  if (move & FLAG_EN_PASSANT)
+  {
+    occupancy ^= SetMask[board->side == WHITE ? to - 8 : to + 8];
+  }
+
+  u64 attackers = GetAttackers(board, to, occupancy) & occupancy;
+  while (depth < 31)
+  {
+    u64 bit = 0ULL;
+    int attacker = GetLeastValuableAttacker(board, attackers & board->occupancy[side], side, &bit);
+    if (attacker == EMPTY)
+    {
+      break;
+    }
+
+    // Each side captures the last piece to move onto the target, or stops if that loses more
+    depth++;
+    gains[depth] = PieceValues[piece] - gains[depth - 1];
+
+    // Removing the attacker uncovers any x-ray sliders behind it
+    occupancy ^= bit;
+    attackers |= (GetBishopAttacks(to, occupancy) & bishopsOrQueens) | (GetRookAttacks(to, occupancy) & rooksOrQueens);
+    attackers &= occupancy;
+    piece = attacker;
+    side ^= 1;
+  }
+
+  while (depth > 0)
+  {
+    depth--;
+    gains[depth] = -(-gains[depth] > gains[depth + 1] ? -gains[depth] : gains[depth + 1]);
+  }
+  return gains[0];
+}
+
+//// Hash table ////
+
+// Initialize hash table with size in megabytes
+void InitHashTable(HashTable *table, int megabytes)
+{
+  u64 buckets = 1ULL;
+  u64 bytes = (u64)megabytes << 20;
+
+  while (buckets * 2 * sizeof(HashBucket) <= bytes)
+  {
+    buckets *= 2;
+  }
+
+  // Halve the table until the allocation succeeds
+  table->memory = calloc(buckets * sizeof(HashBucket) + 63, 1);
+  while (table->memory == NULL && buckets > 1)
+  {
+    buckets /= 2;
+    table->memory = calloc(buckets * sizeof(HashBucket) + 63, 1);
+  }
+  if (table->memory == NULL)
+  {
+    printf("Failed to allocate hash table\n");
+    exit(1);
+  }
+  if (buckets * sizeof(HashBucket) * 2 <= bytes)
+  {
+    printf("info string hash table reduced to %d MB\n", (int)((buckets * sizeof(HashBucket)) >> 20));
+  }
+
+  table->buckets = (HashBucket *)(((uintptr_t)table->memory + 63) & ~(uintptr_t)63);
+  table->mask = buckets - 1;
+  table->megabytes = (int)((buckets * sizeof(HashBucket)) >> 20);
+  table->age = 0;
+}
+
+// Free hash table
+void FreeHashTable(HashTable *table)
+{
+  free(table->memory);
+  table->memory = NULL;
+  table->buckets = NULL;
+  table->mask = 0ULL;
+}
+
+// Clear hash table
+void ClearHashTable(HashTable *table)
+{
+  memset(table->buckets, 0, (table->mask + 1) * sizeof(HashBucket));
+  table->age = 0;
+}
+
+// Pack hash entry data, keeping the top bits of the position key for verification
+u64 PackHashData(u64 key, int move, int score, int depth, int bound, int age)
+{
+  ASSERT(move >= 0 && move <= 0xffff);
+  ASSERT(score > -INFINITE && score < INFINITE);
+  ASSERT(depth >= 0 && depth < MAX_DEPTH);
+
+  return (u64)move | ((u64)(score + 32768) << 16) | ((u64)depth << 32) | ((u64)bound << 39) | ((u64)(age & 0x3f) << 41) | (key & HASH_KEY_MASK);
+}
+
+// Get compact move from hash data
+int GetHashMove(u64 data)
+{
+  return (int)(data & 0xffff);
+}
+
+// Get score from hash data
+int GetHashScore(u64 data)
+{
+  return (int)((data >> 16) & 0xffff) - 32768;
+}
+
+// Get depth from hash data
+int GetHashDepth(u64 data)
+{
+  return (int)((data >> 32) & 0x7f);
+}
+
+// Get bound from hash data
+int GetHashBound(u64 data)
+{
+  return (int)((data >> 39) & 0x3);
+}
+
+// Get age from hash data
+int GetHashAge(u64 data)
+{
+  return (int)((data >> 41) & 0x3f);
+}
+
+// Probe hash table for position, returning its data or zero when absent
+u64 ProbeHashTable(const HashTable *table, u64 key)
+{
+  const HashBucket *bucket = &table->buckets[key & table->mask];
+
+  for (int i = 0; i < HASH_BUCKET_SIZE; ++i)
+  {
+    // Entries are single words, so a concurrent write is never seen half done
+    u64 data = bucket->entries[i].data;
+    if (data && ((data ^ key) & HASH_KEY_MASK) == 0)
+    {
+      return data;
+    }
+  }
+  return 0ULL;
+}
+
+// Store position in hash table, replacing the same position or else the shallowest and oldest entry
+void StoreHashTable(HashTable *table, u64 key, int move, int score, int depth, int bound, int ply)
+{
+  HashBucket *bucket = &table->buckets[key & table->mask];
+  HashEntry *replace = &bucket->entries[0];
+  int worst = INFINITE;
+
+  // Mate scores are stored relative to the position rather than the root
+  if (score > MATE - MAX_DEPTH)
+  {
+    score += ply;
+  }
+  else if (score < -MATE + MAX_DEPTH)
+  {
+    score -= ply;
+  }
+
+  u64 previous = 0ULL;
+  for (int i = 0; i < HASH_BUCKET_SIZE; ++i)
+  {
+    HashEntry *entry = &bucket->entries[i];
+    u64 data = entry->data;
+    if (!data || ((data ^ key) & HASH_KEY_MASK) == 0)
+    {
+      replace = entry;
+      previous = data;
+      break;
+    }
+
+    int worth = GetHashDepth(data) - 4 * ((table->age - GetHashAge(data)) & 0x3f);
+    if (worth < worst)
+    {
+      worst = worth;
+      replace = entry;
+    }
+  }
+
+  // Keep the previous move when the new result has none
+  int compact = GetCompactFromMoveKey(move);
+  if (compact == NO_MOVE && previous)
+  {
+    compact = GetHashMove(previous);
+  }
+
+  replace->data = PackHashData(key, compact, score, depth, bound, table->age);
+}
+
+// Get hash score adjusted to the current ply
+int GetHashScoreFromPly(u64 data, int ply)
+{
+  int score = GetHashScore(data);
+
+  if (score > MATE - MAX_DEPTH)
+  {
+    score -= ply;
+  }
+  else if (score < -MATE + MAX_DEPTH)
+  {
+    score += ply;
+  }
+  return score;
+}
+
+// Get permill of sampled entries written during the current search
+int GetHashFull(const HashTable *table)
+{
+  int used = 0;
+  int samples = 0;
+
+  for (u64 i = 0; i <= table->mask && samples < 1000; ++i)
+  {
+    for (int j = 0; j < HASH_BUCKET_SIZE && samples < 1000; ++j, ++samples)
+    {
+      u64 data = table->buckets[i].entries[j].data;
+      used += data && GetHashAge(data) == (table->age & 0x3f);
+    }
+  }
+  return samples > 0 ? used * 1000 / samples : 0;
+}
+
+//// Evaluation ////
+
+// Get game phase from the remaining pieces, from zero in a pawn ending to the full phase at the start
+int GetGamePhase(const Board *board)
+{
+  // Major piece counters include the king, and queens weigh double a rook
+  int minors = board->minorPieces[WHITE] + board->minorPieces[BLACK];
+  int majors = board->majorPieces[WHITE] + board->majorPieces[BLACK] - 2;
+  int phase = minors + 2 * majors + 2 * (board->counts[WHITE_QUEEN] + board->counts[BLACK_QUEEN]);
+
+  return phase < PHASE_MAX ? phase : PHASE_MAX;
+}
+
+// Initialize pawn table
+void InitPawnTable(PawnTable *table)
+{
+  table->entries = calloc(PAWN_TABLE_SIZE, sizeof(PawnEntry));
+  table->probes = 0ULL;
+  table->hits = 0ULL;
+}
+
+// Free pawn table
+void FreePawnTable(PawnTable *table)
+{
+  free(table->entries);
+  table->entries = NULL;
+}
+
+// Evaluate passed, isolated, doubled and backward pawns of a side
+void EvaluatePawnSide(const Board *board, int side, int *middlegame, int *endgame)
+{
+  u64 ownPawns = board->pawns[side];
+  u64 enemyPawns = board->pawns[side ^ 1];
+  u64 pawns = ownPawns;
+
+  while (pawns)
+  {
+    int index = PopBit(&pawns);
+    int file = index % 8;
+    int rank = side == WHITE ? index / 8 : 7 - index / 8;
+    int stop = side == WHITE ? index + 8 : index - 8;
+
+    if (!(PassedMasks[side][index] & enemyPawns))
+    {
+      *middlegame += PassedMiddlegame[rank];
+      *endgame += PassedEndgame[rank];
+    }
+    if (!(AdjacentFileMasks[file] & ownPawns))
+    {
+      *middlegame += IsolatedMiddlegame;
+      *endgame += IsolatedEndgame;
+    }
+    else if (!(SupportMasks[side][index] & ownPawns) && (PawnAttacks[side][stop] & enemyPawns))
+    {
+      // No pawn can come alongside, and advancing walks into an enemy pawn attack
+      *middlegame += BackwardMiddlegame;
+      *endgame += BackwardEndgame;
+    }
+  }
+
+  for (int file = FILE_A; file <= FILE_H; ++file)
+  {
+    int count = CountBit(ownPawns & FileMasks[file]);
+    if (count > 1)
+    {
+      *middlegame += DoubledMiddlegame * (count - 1);
+      *endgame += DoubledEndgame * (count - 1);
+    }
+  }
+}
+
+// Probe pawn table for the pawn structure scores for white, evaluating them on a miss
+void ProbePawnTable(PawnTable *table, const Board *board, int *middlegame, int *endgame)
+{
+  PawnEntry *entry = &table->entries[board->pawnKey & (PAWN_TABLE_SIZE - 1)];
+
+  table->probes++;
+  if (entry->key == board->pawnKey)
+  {
+    table->hits++;
+    *middlegame = entry->middlegame;
+    *endgame = entry->endgame;
+    return;
+  }
+
+  int whiteMiddlegame = 0;
+  int whiteEndgame = 0;
+  int blackMiddlegame = 0;
+  int blackEndgame = 0;
+  EvaluatePawnSide(board, WHITE, &whiteMiddlegame, &whiteEndgame);
+  EvaluatePawnSide(board, BLACK, &blackMiddlegame, &blackEndgame);
+
+  entry->key = board->pawnKey;
+  entry->middlegame = whiteMiddlegame - blackMiddlegame;
+  entry->endgame = whiteEndgame - blackEndgame;
+  *middlegame = entry->middlegame;
+  *endgame = entry->endgame;
+}
+
+// Evaluate position from the side to move, blending the piece-square sums and pawn structure by game phase
+int Evaluate(Board *board, PawnTable *pawnTable)
+{
+  if (NnueLoaded)
+  {
+    return NnueEvaluate(board);
+  }
+
+  int phase = GetGamePhase(board);
+  int pawnMiddlegame = 0;
+  int pawnEndgame = 0;
+
+  ProbePawnTable(pawnTable, board, &pawnMiddlegame, &pawnEndgame);
+
+  int middlegame = board->middlegameScores[WHITE] - board->middlegameScores[BLACK] + pawnMiddlegame;
+  int endgame = board->endgameScores[WHITE] - board->endgameScores[BLACK] + pawnEndgame;
+  int score = (middlegame * phase + endgame * (PHASE_MAX - phase)) / PHASE_MAX;
+
+  return board->side == WHITE ? score : -score;
+}
+
+//// Bitbase ////
+
+// Get piece of the other color
+int FlipPieceColor(int piece)
+{
+  return piece == EMPTY ? EMPTY : piece <= WHITE_KING ? piece + 6 : piece - 6;
+}
+
+// Get canonical bitbase name from piece counts with the stronger side first, returning whether the colors were swapped
+int GetBitbaseName(const int *counts, char *name)
+{
+  char sides[SIDE_SIZE][MAX_BITBASE_PIECES + 1];
+  int values[SIDE_SIZE] = { 0, 0 };
+
+  for (int side = WHITE; side <= BLACK; ++side)
+  {
+    int king = side == WHITE ? WHITE_KING : BLACK_KING;
+    int length = 0;
+
+    sides[side][length++] = 'K';
+    for (int piece = king - 1; piece > king - 6; --piece)
+    {
+      for (int i = 0; i < counts[piece] && length < MAX_BITBASE_PIECES; ++i)
+      {
+        sides[side][length++] = PieceCharacters[piece - 6 * side];
+        values[side] += PieceValues[piece];
+      }
+    }
+    sides[side][length] = '\0';
+  }
+
+  int swapped = values[BLACK] > values[WHITE] || (values[BLACK] == values[WHITE] && strcmp(sides[BLACK], sides[WHITE]) > 0);
+  snprintf(name, MAX_BITBASE_PIECES + 1, "%s%s", sides[swapped], sides[swapped ^ 1]);
+  return swapped;
+}
+
+// Parse bitbase name such as KQKR into a bitbase with its canonical name and piece order
+int ParseBitbaseName(const char *name, Bitbase *bitbase)
+{
+  int counts[PIECE_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+  int side = -1;
+  int total = 0;
+
+  for (const char *c = name; *c != '\0'; ++c)
+  {
+    const char *found = strchr(PieceCharacters + WHITE_PAWN, *c);
+    if (found == NULL || found - PieceCharacters > WHITE_KING || (side < 0 && *c != 'K') || ++total > MAX_BITBASE_PIECES)
+    {
+      return FALSE;
+    }
+    if (*c == 'K' && ++side > BLACK)
+    {
+      return FALSE;
+    }
+    counts[(found - PieceCharacters) + 6 * side]++;
+  }
+  if (side != BLACK)
+  {
+    return FALSE;
+  }
+
+  if (GetBitbaseName(counts, bitbase->name))
+  {
+    for (int piece = WHITE_PAWN; piece <= WHITE_KING; ++piece)
+    {
+      int temp = counts[piece];
+      counts[piece] = counts[piece + 6];
+      counts[piece + 6] = temp;
+    }
+  }
+
+  // Each king leads its side, and the white king decides the board symmetry
+  bitbase->count = 0;
+  for (int side = WHITE; side <= BLACK; ++side)
+  {
+    int king = side == WHITE ? WHITE_KING : BLACK_KING;
+    for (int piece = king; piece > king - 6; --piece)
+    {
+      for (int i = 0; i < counts[piece]; ++i)
+      {
+        bitbase->pieces[bitbase->count++] = piece;
+      }
+    }
+  }
+  memcpy(bitbase->counts, counts, sizeof(counts));
+  bitbase->hasPawns = counts[WHITE_PAWN] + counts[BLACK_PAWN] > 0;
+
+  bitbase->entries = (bitbase->hasPawns ? 32ULL : 10ULL) * SIDE_SIZE;
+  for (int i = 1; i < bitbase->count; ++i)
+  {
+    bitbase->entries *= INDEX_SIZE;
+  }
+  bitbase->data = NULL;
+  bitbase->mapping = NULL;
+  bitbase->mappingSize = 0;
+  return TRUE;
+}
+
+// Get index under a symmetry that mirrors the file, mirrors the rank and then transposes
+int TransformIndex(int index, int mirrorFile, int mirrorRank, int transpose)
+{
+  int file = mirrorFile ? 7 - index % 8 : index % 8;
+  int rank = mirrorRank ? 7 - index / 8 : index / 8;
+
+  return transpose ? file * 8 + rank : rank * 8 + file;
+}
+
+// Get bitbase index from piece indices in bitbase order and the side to move
+u64 GetBitbaseIndex(const Bitbase *bitbase, const int *indices, int side)
+{
+  // Move the white king to files a to d, and also below the diagonal of the a1-d1-d4 triangle without pawns
+  int king = indices[0];
+  int mirrorFile = king % 8 > FILE_D;
+  int mirrorRank = !bitbase->hasPawns && king / 8 > RANK_4;
+  king = TransformIndex(king, mirrorFile, mirrorRank, FALSE);
+  int transpose = !bitbase->hasPawns && king / 8 > king % 8;
+  king = TransformIndex(king, FALSE, FALSE, transpose);
+
+  u64 index = bitbase->hasPawns ? (u64)(king / 8 * 4 + king % 8) : (u64)KingTriangleSlots[king];
+  for (int i = 1; i < bitbase->count; ++i)
+  {
+    index = index * INDEX_SIZE + TransformIndex(indices[i], mirrorFile, mirrorRank, transpose);
+  }
+  return index * SIDE_SIZE + side;
+}
+
+// Get piece indices in bitbase order and the side to move from a bitbase index
+void GetBitbaseIndices(const Bitbase *bitbase, u64 index, int *indices, int *side)
+{
+  *side = (int)(index % SIDE_SIZE);
+  index /= SIDE_SIZE;
+  for (int i = bitbase->count - 1; i > 0; --i)
+  {
+    indices[i] = (int)(index % INDEX_SIZE);
+    index /= INDEX_SIZE;
+  }
+  indices[0] = bitbase->hasPawns ? (int)(index / 4 * 8 + index % 4) : KingTriangleIndices[index];
+}
+
+// Get packed bitbase value
+int GetBitbaseValue(const unsigned char *data, u64 index)
+{
+  return (data[index / 4] >> (2 * (index % 4))) & 3;
+}
+
+// Set packed bitbase value
+void SetBitbaseValue(unsigned char *data, u64 index, int value)
+{
+  int shift = 2 * (index % 4);
+  data[index / 4] = (unsigned char)((data[index / 4] & ~(3 << shift)) | (value << shift));
+}
+
+// Check whether board material matches a bitbase, directly or with the colors swapped
+int MatchBitbase(const Bitbase *bitbase, const Board *board, int *swapped)
+{
+  int direct = TRUE;
+  int flipped = TRUE;
+
+  for (int piece = WHITE_PAWN; piece <= BLACK_KING; ++piece)
+  {
+    direct = direct && board->counts[piece] == bitbase->counts[piece];
+    flipped = flipped && board->counts[piece] == bitbase->counts[FlipPieceColor(piece)];
+  }
+  *swapped = !direct;
+  return direct || flipped;
+}
+
+// Get bitbase index of a board with matching material, flipping the board vertically when the colors are swapped
+u64 GetBoardBitbaseIndex(const Bitbase *bitbase, const Board *board, int swapped)
+{
+  int indices[MAX_BITBASE_PIECES];
+  u64 used = 0ULL;
+
+  // Pieces of the same kind take their squares in any order, as every order is stored
+  for (int i = 0; i < bitbase->count; ++i)
+  {
+    int piece = swapped ? FlipPieceColor(bitbase->pieces[i]) : bitbase->pieces[i];
+    u64 bitboard = board->bitboards[piece] & ~used;
+    int index = PopBit(&bitboard);
+
+    used |= SetMask[index];
+    indices[i] = swapped ? index ^ 56 : index;
+  }
+  return GetBitbaseIndex(bitbase, indices, swapped ? board->side ^ 1 : board->side);
+}
+
+// Probe loaded bitbases for the value from the side to move, returning whether one covers the position
+int ProbeBitbase(const Board *board, int *value)
+{
+  int swapped = FALSE;
+
+  // Bare kings need no table
+  if (board->bigPieces[WHITE] + board->bigPieces[BLACK] == 2 && board->pawns[BOTH] == 0ULL)
+  {
+    *value = BITBASE_DRAW;
+    return TRUE;
+  }
+
+  for (int i = 0; i < BitbaseCount; ++i)
+  {
+    if (MatchBitbase(&Bitbases[i], board, &swapped))
+    {
+      *value = GetBitbaseValue(Bitbases[i].data, GetBoardBitbaseIndex(&Bitbases[i], board, swapped));
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Set up board from piece indices in bitbase order, returning whether the position is legal
+int SetBitbaseBoard(Board *board, const Bitbase *bitbase, const int *indices, int side)
+{
+  ResetBoard(board);
+
+  for (int i = 0; i < bitbase->count; ++i)
+  {
+    int position = GetPositionFromIndex(indices[i]);
+    int pawn = bitbase->pieces[i] == WHITE_PAWN || bitbase->pieces[i] == BLACK_PAWN;
+    if (board->pieces[position] != EMPTY || (pawn && (indices[i] / 8 == RANK_1 || indices[i] / 8 == RANK_8)))
+    {
+      return FALSE;
+    }
+    board->pieces[position] = bitbase->pieces[i];
+  }
+
+  board->side = side;
+  UpdateMaterial(board);
+  board->positionKey = GeneratePositionKey(board);
+  board->pawnKey = GeneratePawnKey(board);
+
+  // The side not to move cannot be in check
+  return !IsPositionAttacked(board->kingSquares[side ^ 1], side, board);
+}
+
+// Get value from the side to move by looking up every legal move in the previous pass
+int GetBitbaseMovesValue(Board *board, const Bitbase *bitbase, const unsigned char *current)
+{
+  MoveList list[1];
+  int legal = 0;
+  int allWins = TRUE;
+  int swapped = FALSE;
+
+  GenerateAllMoves(board, list);
+  for (int i = 0; i < list->count; ++i)
+  {
+    int move = GetMoveKeyFromCompact(board, list->moves[i]);
+    int value = BITBASE_DRAW;
+
+    if (!MakeMove(board, move))
+    {
+      continue;
+    }
+    legal++;
+
+    // Captures and promotions convert to smaller bitbases, and positions allowing en passant are not stored
+    if (board->enPassant != XX)
+    {
+      value = GetBitbaseMovesValue(board, bitbase, current);
+    }
+    else if (move & (FLAG_CAPTURE | FLAG_PROMOTION))
+    {
+      ProbeBitbase(board, &value);
+    }
+    else
+    {
+      MatchBitbase(bitbase, board, &swapped);
+      value = GetBitbaseValue(current, GetBoardBitbaseIndex(bitbase, board, swapped));
+    }
+    TakeMove(board);
+
+    if (value == BITBASE_LOSS)
+    {
+      return BITBASE_WIN;
+    }
+    allWins = allWins && value == BITBASE_WIN;
+  }
+
+  if (legal == 0)
+  {
+    return IsPositionAttacked(board->kingSquares[board->side], board->side ^ 1, board) ? BITBASE_LOSS : BITBASE_DRAW;
+  }
+  return allWins ? BITBASE_LOSS : BITBASE_DRAW;
+}
+
+// Bitbase worker thread, running one pass over chunks of the bitbase
+void *BitbaseWorkerThread(void *arg)
+{
+  BitbaseWorker *worker = (BitbaseWorker *)arg;
+  const Bitbase *bitbase = worker->bitbase;
+  u64 chunks = (bitbase->entries + BITBASE_CHUNK_SIZE - 1) / BITBASE_CHUNK_SIZE;
+  u64 chunk = 0ULL;
+
+  // Chunks cover whole bytes, so workers never write the same byte
+  while ((chunk = atomic_fetch_add(worker->next, 1ULL)) < chunks)
   {
-    int piece = board->pieces[i];
-    if (piece != OB && piece != EMPTY)
+    u64 end = (chunk + 1) * BITBASE_CHUNK_SIZE < bitbase->entries ? (chunk + 1) * BITBASE_CHUNK_SIZE : bitbase->entries;
+
+    for (u64 index = chunk * BITBASE_CHUNK_SIZE; index < end; ++index)
     {
-      int color = PieceColors[piece];
+      int indices[MAX_BITBASE_PIECES];
+      int side = WHITE;
 
-      // Piece type
-      if (BigPieces[piece])
+      // Decided and illegal positions are final
+      if (GetBitbaseValue(worker->current, index) != BITBASE_DRAW)
       {
-        board->bigPieces[color]++;
+        continue;
       }
-      if (MajorPieces[piece])
+
+      GetBitbaseIndices(bitbase, index, indices, &side);
+      if (!SetBitbaseBoard(&worker->board, bitbase, indices, side))
       {
-        board->majorPieces[color]++;
+        SetBitbaseValue(worker->updated, index, BITBASE_INVALID);
+        continue;
+      }
+
+      int value = GetBitbaseMovesValue(&worker->board, bitbase, worker->current);
+      if (value != BITBASE_DRAW)
+      {
+        SetBitbaseValue(worker->updated, index, value);
+        worker->changed++;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Load bitbase from a directory by memory mapping its file
+int LoadBitbase(const char *directory, const char *name)
+{
+  Bitbase bitbase[1];
+  BitbaseHeader header;
+  char path[MAX_PATH_LENGTH];
+
+  if (!ParseBitbaseName(name, bitbase))
+  {
+    return FALSE;
+  }
+  for (int i = 0; i < BitbaseCount; ++i)
+  {
+    if (!strcmp(Bitbases[i].name, bitbase->name))
+    {
+      return TRUE;
+    }
+  }
+  if (BitbaseCount >= MAX_BITBASES)
+  {
+    return FALSE;
+  }
+
+  snprintf(path, sizeof(path), "%s/%s.bb", directory, bitbase->name);
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+  {
+    return FALSE;
+  }
+
+  size_t size = sizeof(header) + (size_t)((bitbase->entries + 3) / 4);
+  int ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == BITBASE_MAGIC && header.entries == bitbase->entries;
+
+#ifdef _WIN32
+  // Read the whole file where mmap is not available
+  bitbase->mapping = ok ? malloc(size) : NULL;
+  ok = bitbase->mapping != NULL && fseek(file, 0, SEEK_SET) == 0 && fread(bitbase->mapping, size, 1, file) == 1;
+  if (!ok)
+  {
+    free(bitbase->mapping);
+  }
+#else
+  struct stat status;
+  ok = ok && fstat(fileno(file), &status) == 0 && (size_t)status.st_size == size;
+  bitbase->mapping = ok ? mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(file), 0) : MAP_FAILED;
+  ok = bitbase->mapping != MAP_FAILED;
+#endif
+  fclose(file);
+
+  if (!ok)
+  {
+    return FALSE;
+  }
+  bitbase->mappingSize = size;
+  bitbase->data = (const unsigned char *)bitbase->mapping + sizeof(header);
+  Bitbases[BitbaseCount++] = *bitbase;
+  return TRUE;
+}
+
+// Load bitbases from a directory, skipping missing files
+int LoadBitbases(const char *directory, char *names[], int count)
+{
+  int loaded = 0;
+
+  for (int i = 0; i < count; ++i)
+  {
+    loaded += LoadBitbase(directory, names[i]);
+  }
+  return loaded;
+}
+
+// Free loaded bitbases
+void FreeBitbases()
+{
+  for (int i = 0; i < BitbaseCount; ++i)
+  {
+#ifdef _WIN32
+    free(Bitbases[i].mapping);
+#else
+    munmap(Bitbases[i].mapping, Bitbases[i].mappingSize);
+#endif
+  }
+  BitbaseCount = 0;
+}
+
+// Generate bitbase, after the smaller ones it converts into, and write it to a directory
+int GenerateBitbase(const char *directory, const char *name, int threads)
+{
+  Bitbase bitbase[1];
+  char path[MAX_PATH_LENGTH];
+
+  if (!ParseBitbaseName(name, bitbase))
+  {
+    printf("Invalid bitbase %s\n", name);
+    return FALSE;
+  }
+  if (LoadBitbase(directory, bitbase->name))
+  {
+    return TRUE;
+  }
+
+  // Captures remove a piece other than a king, and promotions turn a pawn into a piece, possibly capturing too
+  char children[MAX_CHOICES][MAX_BITBASE_PIECES + 1];
+  int childCount = 0;
+  for (int piece = WHITE_PAWN; piece <= BLACK_QUEEN; ++piece)
+  {
+    int pawn = piece == WHITE_PAWN || piece == BLACK_PAWN;
+    if (bitbase->counts[piece] == 0 || piece == WHITE_KING)
+    {
+      continue;
+    }
+
+    for (int promotion = piece; promotion <= (pawn ? piece + 4 : piece); ++promotion)
+    {
+      for (int capture = EMPTY; capture <= BLACK_QUEEN; ++capture)
+      {
+        int counts[PIECE_SIZE];
+        int total = bitbase->count - 1;
+
+        // Promoting pieces only capture pieces other than pawns
+        if (capture != EMPTY && (promotion == piece || bitbase->counts[capture] == 0 || PieceColors[capture] == PieceColors[piece] || !BigPieces[capture] || KingPieces[capture]))
+        {
+          continue;
+        }
+
+        memcpy(counts, bitbase->counts, sizeof(counts));
+        counts[piece]--;
+        if (promotion != piece)
+        {
+          counts[promotion]++;
+          total++;
+        }
+        if (capture != EMPTY)
+        {
+          counts[capture]--;
+          total--;
+        }
+        if (total > 2)
+        {
+          GetBitbaseName(counts, children[childCount++]);
+        }
+      }
+    }
+  }
+  for (int i = 0; i < childCount; ++i)
+  {
+    if (!GenerateBitbase(directory, children[i], threads))
+    {
+      return FALSE;
+    }
+  }
+
+  printf("Generating %s with %llu positions on %d threads\n", bitbase->name, bitbase->entries, threads);
+  fflush(stdout);
+  long start = GetTimeMs();
+
+  // Double buffer the passes, so each one only reads values decided by the previous one
+  size_t bytes = (size_t)((bitbase->entries + 3) / 4);
+  unsigned char *current = calloc(bytes, 1);
+  unsigned char *updated = calloc(bytes, 1);
+  BitbaseWorker *workers = malloc(threads * sizeof(BitbaseWorker));
+  pthread_t handles[MAX_THREADS];
+  for (int i = 0; i < threads; ++i)
+  {
+    InitBoard(&workers[i].board);
+  }
+  int passes = 0;
+  u64 changed = 0ULL;
+
+  do
+  {
+    atomic_ullong next = 0ULL;
+    memcpy(updated, current, bytes);
+
+    for (int i = 0; i < threads; ++i)
+    {
+      workers[i].bitbase = bitbase;
+      workers[i].current = current;
+      workers[i].updated = updated;
+      workers[i].next = &next;
+      workers[i].changed = 0ULL;
+      pthread_create(&handles[i], NULL, BitbaseWorkerThread, &workers[i]);
+    }
+
+    changed = 0ULL;
+    for (int i = 0; i < threads; ++i)
+    {
+      pthread_join(handles[i], NULL);
+      changed += workers[i].changed;
+    }
+
+    unsigned char *temp = current;
+    current = updated;
+    updated = temp;
+    passes++;
+  } while (changed > 0ULL);
+
+  // Undecided positions are left as draws
+  u64 results[4] = { 0ULL, 0ULL, 0ULL, 0ULL };
+  for (u64 i = 0; i < bitbase->entries; ++i)
+  {
+    results[GetBitbaseValue(current, i)]++;
+  }
+
+  BitbaseHeader header = { BITBASE_MAGIC, 1, bitbase->entries };
+  snprintf(path, sizeof(path), "%s/%s.bb", directory, bitbase->name);
+  FILE *file = fopen(path, "wb");
+  int ok = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(current, bytes, 1, file) == 1;
+  if (file != NULL)
+  {
+    ok = fclose(file) == 0 && ok;
+  }
+
+  printf("%s: %d passes, %llu wins, %llu draws, %llu losses, %llu illegal in %ld ms\n", bitbase->name, passes, results[BITBASE_WIN], results[BITBASE_DRAW], results[BITBASE_LOSS], results[BITBASE_INVALID], GetTimeMs() - start);
+  fflush(stdout);
+
+  for (int i = 0; i < threads; ++i)
+  {
+    FreeBoard(&workers[i].board);
+  }
+  free(current);
+  free(updated);
+  free(workers);
+
+  if (!ok)
+  {
+    printf("Failed to write %s\n", path);
+    return FALSE;
+  }
+  return LoadBitbase(directory, bitbase->name);
+}
+
+//// Draw ////
+
+// Check whether the position repeats one since the last irreversible move, comparing only positions with the same side to move
+int IsRepetition(const Board *board)
+{
+  int last = board->historyPly - board->fiftyMoves;
+  last = last > 0 ? last : 0;
+
+  // Returning to a position takes at least four plies
+  for (int i = board->historyPly - 4; i >= last; i -= 2)
+  {
+    if (board->history[i].positionKey == board->positionKey)
+    {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// Check whether the position is drawn by repetition or by the fifty-move rule, unless the last move gave checkmate
+int IsDraw(const Board *board)
+{
+  if (board->fiftyMoves >= 100)
+  {
+    return !IsPositionAttacked(board->kingSquares[board->side], board->side ^ 1, board) || CountLegalMoves(board) > 0;
+  }
+  return board->fiftyMoves >= 4 && IsRepetition(board);
+}
+
+// Check whether the side to move can repeat a position inside the search with one reversible move
+int HasUpcomingRepetition(const Board *board, int ply)
+{
+  int end = board->fiftyMoves < board->historyPly ? board->fiftyMoves : board->historyPly;
+
+  for (int i = 3; i <= end; i += 2)
+  {
+    // The key difference to an earlier position is the key of the move reaching it
+    u64 moveKey = board->positionKey ^ board->history[board->historyPly - i].positionKey;
+    int slot = GetCuckooSlot(moveKey, 0);
+    if (CuckooKeys[slot] != moveKey)
+    {
+      slot = GetCuckooSlot(moveKey, 1);
+      if (CuckooKeys[slot] != moveKey)
+      {
+        continue;
+      }
+    }
+
+    // The path has to be clear and the moving piece has to belong to the side to move, and the repeated position inside the search
+    int from = CuckooFrom[slot];
+    int to = CuckooTo[slot];
+    if (BetweenMask[from][to] & board->occupancy[BOTH])
+    {
+      continue;
+    }
+    int piece = board->pieces[GetPositionFromIndex(board->pieces[GetPositionFromIndex(from)] != EMPTY ? from : to)];
+    if (PieceColors[piece] == board->side && ply > i)
+    {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+//// Search ////
+
+// Count a node visited by a thread, which only that thread writes while the main thread reads it for reports
+u64 CountNode(SearchThread *thread)
+{
+  u64 nodes = atomic_load_explicit(&thread->nodes, memory_order_relaxed) + 1;
+  atomic_store_explicit(&thread->nodes, nodes, memory_order_relaxed);
+  return nodes;
+}
+
+// Check search limits
+void CheckUp(SearchThread *thread)
+{
+  SearchInfo *info = thread->info;
+
+  // Node limit counts every thread
+  u64 nodes = atomic_fetch_add(&info->nodes, (u64)CHECK_INTERVAL) + CHECK_INTERVAL;
+  if (info->nodeLimit && nodes >= info->nodeLimit)
+  {
+    info->stopped = TRUE;
+  }
+  if (info->timeSet && GetTimeMs() >= info->stopTime)
+  {
+    info->stopped = TRUE;
+  }
+}
+
+// Pick move with the highest score and swap it to index
+void PickNextMove(MoveList *list, int index)
+{
+  int best = index;
+
+  for (int i = index + 1; i < list->count; ++i)
+  {
+    if (list->scores[i] > list->scores[best])
+    {
+      best = i;
+    }
+  }
+
+  CompactMove move = list->moves[index];
+  int score = list->scores[index];
+  list->moves[index] = list->moves[best];
+  list->scores[index] = list->scores[best];
+  list->moves[best] = move;
+  list->scores[best] = score;
+}
+
+// Check whether a move is neither a capture nor a promotion
+int IsMoveQuiet(int move)
+{
+  return !(move & (FLAG_CAPTURE | FLAG_PROMOTION));
+}
+
+// Get countermove slot for the previous move
+int *GetCounterMove(SearchThread *thread)
+{
+  const Board *board = &thread->board;
+
+  if (board->historyPly == 0 || board->history[board->historyPly - 1].move == NO_MOVE)
+  {
+    return NULL;
+  }
+
+  int to = GetToPositionFromMoveKey(board->history[board->historyPly - 1].move);
+  return &thread->counterMoves[board->pieces[to]][GetIndexFromPosition(to)];
+}
+
+// Initialize move picker
+void InitMovePicker(MovePicker *picker, SearchThread *thread, int hashMove)
+{
+  int ply = thread->board.currentPly;
+  int *counterMove = GetCounterMove(thread);
+
+  picker->index = 0;
+  picker->stage = STAGE_HASH;
+  picker->hashMove = hashMove;
+  picker->list.count = 0;
+  picker->refutations[0] = thread->killers[ply][0];
+  picker->refutations[1] = thread->killers[ply][1];
+  picker->refutations[2] = counterMove != NULL ? *counterMove : NO_MOVE;
+  picker->refutationIndex = 0;
+  picker->badCaptures.count = 0;
+  picker->badIndex = 0;
+
+  if (picker->refutations[2] == picker->refutations[0] || picker->refutations[2] == picker->refutations[1])
+  {
+    picker->refutations[2] = NO_MOVE;
+  }
+}
+
+// Check whether a move has already been tried by an earlier stage
+int IsMovePicked(const MovePicker *picker, int move)
+{
+  return move == picker->hashMove || move == picker->refutations[0] || move == picker->refutations[1] || move == picker->refutations[2];
+}
+
+// Score quiet moves by their history
+void ScoreQuietMoves(MoveList *list, const SearchThread *thread)
+{
+  const Board *board = &thread->board;
+
+  for (int i = 0; i < list->count; ++i)
+  {
+    int from = list->moves[i] & 0x3f;
+    int to = (list->moves[i] >> 6) & 0x3f;
+    list->scores[i] = thread->history[board->side][from][to];
+  }
+}
+
+// Update killers, history and countermove for a quiet move causing a beta cutoff
+void UpdateQuietHistory(SearchThread *thread, int move, int depth)
+{
+  Board *board = &thread->board;
+  int ply = board->currentPly;
+  int from = GetIndexFromPosition(GetFromPositionFromMoveKey(move));
+  int to = GetIndexFromPosition(GetToPositionFromMoveKey(move));
+  int *counterMove = GetCounterMove(thread);
+
+  if (thread->killers[ply][0] != move)
+  {
+    thread->killers[ply][1] = thread->killers[ply][0];
+    thread->killers[ply][0] = move;
+  }
+  if (counterMove != NULL)
+  {
+    *counterMove = move;
+  }
+
+  // Halve the side's history when it grows too large, so recent cutoffs keep weight
+  thread->history[board->side][from][to] += depth * depth;
+  if (thread->history[board->side][from][to] > HISTORY_MAX)
+  {
+    for (int i = 0; i < INDEX_SIZE; ++i)
+    {
+      for (int j = 0; j < INDEX_SIZE; ++j)
+      {
+        thread->history[board->side][i][j] /= 2;
+      }
+    }
+  }
+}
+
+// Pick next pseudo-legal move, generating each stage only when the previous one is exhausted
+int NextMove(MovePicker *picker, const SearchThread *thread)
+{
+  const Board *board = &thread->board;
+
+  while (TRUE)
+  {
+    switch (picker->stage)
+    {
+    case STAGE_HASH:
+      picker->stage = STAGE_GENERATE_CAPTURES;
+      if (picker->hashMove != NO_MOVE && IsMovePseudoLegal(board, picker->hashMove))
+      {
+        return picker->hashMove;
+      }
+      break;
+
+    case STAGE_GENERATE_CAPTURES:
+      GenerateAllCaptures(board, &picker->list);
+      picker->index = 0;
+      picker->stage = STAGE_CAPTURES;
+      break;
+
+    case STAGE_CAPTURES:
+      while (picker->index < picker->list.count)
+      {
+        PickNextMove(&picker->list, picker->index);
+        int move = GetMoveKeyFromCompact(board, picker->list.moves[picker->index++]);
+        if (move == picker->hashMove)
+        {
+          continue;
+        }
+
+        // Defer captures losing material, checked only when the attacker outweighs the victim
+        if (GetPromotionFromMoveKey(move) == EMPTY && GetCaptureValue(move) < PieceValues[board->pieces[GetFromPositionFromMoveKey(move)]] && SEE(board, move) < 0)
+        {
+          picker->badCaptures.moves[picker->badCaptures.count++] = picker->list.moves[picker->index - 1];
+          continue;
+        }
+        return move;
       }
-      if (MinorPieces[piece])
+      picker->stage = STAGE_REFUTATIONS;
+      break;
+
+    case STAGE_REFUTATIONS:
+      while (picker->refutationIndex < 3)
       {
-        board->minorPieces[color]++;
+        int move = picker->refutations[picker->refutationIndex++];
+        if (move != NO_MOVE && move != picker->hashMove && IsMoveQuiet(move) && IsMovePseudoLegal(board, move))
+        {
+          return move;
+        }
       }
+      picker->stage = STAGE_GENERATE_QUIETS;
+      break;
 
-      // Material and count
-      board->materials[color] += PieceValues[piece];
-      board->pieceList[piece][board->counts[piece]] = i;
-      board->counts[piece]++;
+    case STAGE_GENERATE_QUIETS:
+      GenerateAllQuiets(board, &picker->list);
+      ScoreQuietMoves(&picker->list, thread);
+      picker->index = 0;
+      picker->stage = STAGE_QUIETS;
+      break;
 
-      // Kings
-      if (piece == WHITE_KING)
-      {
-        board->kingSquares[WHITE] = i;
-      }
-      if (piece == BLACK_KING)
+    case STAGE_QUIETS:
+      while (picker->index < picker->list.count)
       {
-        board->kingSquares[BLACK] = i;
+        PickNextMove(&picker->list, picker->index);
+        int move = GetMoveKeyFromCompact(board, picker->list.moves[picker->index++]);
+        if (!IsMovePicked(picker, move))
+        {
+          return move;
+        }
       }
+      picker->stage = STAGE_BAD_CAPTURES;
+      break;
 
-      // Pawns
-      if (piece == WHITE_PAWN)
+    case STAGE_BAD_CAPTURES:
+      if (picker->badIndex < picker->badCaptures.count)
       {
-        SetBit(&board->pawns[WHITE], GetIndexFromPosition(i));
-        SetBit(&board->pawns[BOTH], GetIndexFromPosition(i));
+        return GetMoveKeyFromCompact(board, picker->badCaptures.moves[picker->badIndex++]);
       }
-      if (piece == BLACK_PAWN)
+      picker->stage = STAGE_DONE;
+      break;
+
+    default:
+      return NO_MOVE;
+    }
+  }
+}
+
+// Quiescence search over captures and promotions with a stand-pat cutoff, or over all evasions when in check
+int Quiescence(SearchThread *thread, int alpha, int beta)
+{
+  Board *board = &thread->board;
+  SearchInfo *info = thread->info;
+  int ply = board->currentPly;
+
+  ASSERT(CheckBoard(board));
+  ASSERT(alpha < beta);
+
+  thread->pvLength[ply] = ply;
+  // Limits
+  if ((CountNode(thread) & (CHECK_INTERVAL - 1)) == 0)
+  {
+    CheckUp(thread);
+  }
+
+  if (ply >= MAX_DEPTH - 1)
+  {
+    return Evaluate(board, &thread->pawnTable);
+  }
+
+  // A side in check cannot stand pat, so every evasion is searched
+  int inCheck = IsPositionAttacked(board->kingSquares[board->side], board->side ^ 1, board);
+  MoveList list[1];
+  if (inCheck)
+  {
+    GenerateAllMoves(board, list);
+  }
+  else
+  {
+    // The side to move can usually do at least as well as the static evaluation
+    int standPat = Evaluate(board, &thread->pawnTable);
+    if (standPat >= beta)
+    {
+      return beta;
+    }
+    if (standPat > alpha)
+    {
+      alpha = standPat;
+    }
+    GenerateAllCaptures(board, list);
+  }
+
+  int legal = 0;
+  for (int i = 0; i < list->count; ++i)
+  {
+    PickNextMove(list, i);
+    int move = GetMoveKeyFromCompact(board, list->moves[i]);
+
+    // Captures losing material cannot raise alpha above the stand pat
+    if (!inCheck && GetPromotionFromMoveKey(move) == EMPTY && SEE(board, move) < 0)
+    {
+      continue;
+    }
+    if (!MakeMove(board, move))
+    {
+      continue;
+    }
+    legal++;
+    int score = -Quiescence(thread, -beta, -alpha);
+    TakeMove(board);
+
+    if (info->stopped)
+    {
+      return 0;
+    }
+
+    if (score > alpha)
+    {
+      if (score >= beta)
       {
-        SetBit(&board->pawns[BLACK], GetIndexFromPosition(i));
-        SetBit(&board->pawns[BOTH], GetIndexFromPosition(i));
+        return beta;
       }
+      alpha = score;
     }
   }
-}
 
-//// Forsyth–Edwards Notation (FEN) ////
+  // Checkmate
+  if (inCheck && legal == 0)
+  {
+    return -MATE + ply;
+  }
+  return alpha;
+}
 
-// Parse FEN notation
-int ParseFen(char *fen, Board *board)
+// Alpha-beta search in negamax form
+int AlphaBeta(SearchThread *thread, int alpha, int beta, int depth)
 {
-  ASSERT(fen != NULL);
-  ASSERT(board != NULL);
+  Board *board = &thread->board;
+  SearchInfo *info = thread->info;
+  int ply = board->currentPly;
 
-  int rank = RANK_8;
-  int file = FILE_A;
-  int piece = 0;
-  int count = 0;
+  ASSERT(CheckBoard(board));
+  ASSERT(alpha < beta);
 
-  ResetBoard(board);
+  // Extend checks so the horizon does not fall inside a forced sequence
+  int inCheck = IsPositionAttacked(board->kingSquares[board->side], board->side ^ 1, board);
+  if (inCheck)
+  {
+    depth++;
+  }
 
-  // Piece states
-  while (rank >= RANK_1 && *fen)
+  if (depth <= 0)
   {
-    count = 1;
-    switch (*fen)
+    return Quiescence(thread, alpha, beta);
+  }
+
+  thread->pvLength[ply] = ply;
+  // Limits
+  if ((CountNode(thread) & (CHECK_INTERVAL - 1)) == 0)
+  {
+    CheckUp(thread);
+  }
+  // Draws by repetition or the fifty-move rule, and draws the side to move can reach by repeating a position
+  if (ply > 0 && IsDraw(board))
+  {
+    return 0;
+  }
+  if (ply > 0 && alpha < 0 && HasUpcomingRepetition(board, ply))
+  {
+    alpha = 0;
+    if (alpha >= beta)
     {
-    // Pieces
-    case 'p':
-      piece = BLACK_PAWN;
-      break;
-    case 'r':
-      piece = BLACK_ROOK;
-      break;
-    case 'n':
-      piece = BLACK_KNIGHT;
-      break;
-    case 'b':
-      piece = BLACK_BISHOP;
-      break;
-    case 'q':
-      piece = BLACK_QUEEN;
-      break;
-    case 'k':
-      piece = BLACK_KING;
-      break;
-    case 'P':
-      piece = WHITE_PAWN;
-      break;
-    case 'R':
-      piece = WHITE_ROOK;
-      break;
-    case 'N':
-      piece = WHITE_KNIGHT;
-      break;
-    case 'B':
-      piece = WHITE_BISHOP;
-      break;
-    case 'Q':
-      piece = WHITE_QUEEN;
-      break;
-    case 'K':
-      piece = WHITE_KING;
-      break;
+      return alpha;
+    }
+  }
+  if (ply >= MAX_DEPTH - 1)
+  {
+    return Evaluate(board, &thread->pawnTable);
+  }
 
-    // Empties
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-      piece = EMPTY;
-      count = *fen - '0';
-      break;
+  // Bitbase result right after a capture or pawn move, so that moves within a won ending are still searched
+  int bitbaseValue = BITBASE_DRAW;
+  if (ply > 0 && BitbaseCount > 0 && board->fiftyMoves == 0 && board->castle == 0 && board->enPassant == XX && CountBit(board->occupancy[BOTH]) <= MAX_BITBASE_PIECES && ProbeBitbase(board, &bitbaseValue))
+  {
+    thread->bitbaseHits++;
+    return bitbaseValue == BITBASE_WIN ? BITBASE_SCORE - ply : bitbaseValue == BITBASE_LOSS ? ply - BITBASE_SCORE : 0;
+  }
 
-    // New rank
-    case '/':
-    case ' ':
-      rank--;
-      file = FILE_A;
-      fen++;
+  // Transposition table cutoff outside the principal variation
+  int hashMove = NO_MOVE;
+  u64 hashData = ProbeHashTable(info->table, board->positionKey);
+  thread->hashProbes++;
+  if (hashData)
+  {
+    thread->hashHits++;
+    int hashScore = GetHashScoreFromPly(hashData, ply);
+    int hashBound = GetHashBound(hashData);
+    hashMove = GetMoveKeyFromCompact(board, GetHashMove(hashData));
+
+    if (ply > 0 && beta - alpha == 1 && GetHashDepth(hashData) >= depth)
+    {
+      if (hashBound == BOUND_EXACT || (hashBound == BOUND_LOWER && hashScore >= beta) || (hashBound == BOUND_UPPER && hashScore <= alpha))
+      {
+        return hashScore;
+      }
+    }
+  }
+
+  MovePicker picker[1];
+  InitMovePicker(picker, thread, hashMove);
+
+  int legal = 0;
+  int oldAlpha = alpha;
+  int bestMove = NO_MOVE;
+  int move = NO_MOVE;
+  while ((move = NextMove(picker, thread)) != NO_MOVE)
+  {
+    if (!MakeMove(board, move))
+    {
       continue;
+    }
+    legal++;
 
-    // Default
-    default:
-      printf("FEN syntax error\n");
-      return -1;
+    // Principal variation search, proving later moves worse with a null window and searching them again if not
+    int score;
+    if (legal == 1)
+    {
+      score = -AlphaBeta(thread, -beta, -alpha, depth - 1);
+    }
+    else
+    {
+      score = -AlphaBeta(thread, -alpha - 1, -alpha, depth - 1);
+      if (score > alpha && score < beta)
+      {
+        score = -AlphaBeta(thread, -beta, -alpha, depth - 1);
+      }
     }
+    TakeMove(board);
 
-    for (int i = 0; i < count; ++i)
+    if (info->stopped)
     {
-      int index = rank * 8 + file;
-      int position = GetPositionFromIndex(index);
-      if (piece != EMPTY)
+      return 0;
+    }
+
+    if (score > alpha)
+    {
+      bestMove = move;
+      if (score >= beta)
       {
-        board->pieces[position] = piece;
+        if (IsMoveQuiet(move))
+        {
+          UpdateQuietHistory(thread, move, depth);
+        }
+        StoreHashTable(info->table, board->positionKey, move, beta, depth, BOUND_LOWER, ply);
+        return beta;
       }
-      file++;
+      alpha = score;
+
+      // Update principal variation
+      thread->pvTable[ply][ply] = GetCompactFromMoveKey(move);
+      for (int j = ply + 1; j < thread->pvLength[ply + 1]; ++j)
+      {
+        thread->pvTable[ply][j] = thread->pvTable[ply + 1][j];
+      }
+      thread->pvLength[ply] = thread->pvLength[ply + 1];
     }
-    fen++;
   }
 
-  // Side
-  ASSERT(*fen == 'w' || *fen == 'b');
-  board->side = *fen == 'w' ? WHITE : BLACK;
-  fen += 2;
+  // Checkmate or stalemate
+  if (legal == 0)
+  {
+    return inCheck ? -MATE + ply : 0;
+  }
 
-  // Castle
-  for (int i = 0; i < 4; ++i)
+  StoreHashTable(info->table, board->positionKey, bestMove, alpha, depth, alpha > oldAlpha ? BOUND_EXACT : BOUND_UPPER, ply);
+  return alpha;
+}
+
+// Print search score in centipawns or moves to mate
+void PrintScore(int score)
+{
+  if (score > MATE - MAX_DEPTH)
   {
-    if (*fen == ' ')
+    printf("score mate %d", (MATE - score + 1) / 2);
+  }
+  else if (score < -MATE + MAX_DEPTH)
+  {
+    printf("score mate %d", -(MATE + score) / 2);
+  }
+  else
+  {
+    printf("score cp %d", score);
+  }
+}
+
+// Search thread with iterative deepening, reporting when it is the main thread and returning the compact best move
+int SearchIterate(SearchThread *thread)
+{
+  SearchInfo *info = thread->info;
+  int bestMove = NO_MOVE;
+  int instability = 0;
+  u64 previousNodes = 0ULL;
+  u64 iterationNodes = 0ULL;
+  u64 lastNodes = 0ULL;
+
+  // Helpers start at staggered depths so the threads spread over different iterations
+  for (int depth = 1 + thread->id % SEARCH_STAGGER; depth <= info->depth; ++depth)
+  {
+    int score = AlphaBeta(thread, -INFINITE, INFINITE, depth);
+
+    // Discard an interrupted iteration unless nothing has completed yet
+    if (info->stopped && bestMove != NO_MOVE)
     {
       break;
     }
 
-    switch (*fen)
+    // Changes of the best move count double, and older ones fade every iteration
+    instability /= 2;
+    if (thread->pvLength[0] > 0)
     {
-    case 'K':
-      board->castle |= CASTLE_WHITE_KING;
-      break;
-    case 'Q':
-      board->castle |= CASTLE_WHITE_QUEEN;
-      break;
-    case 'k':
-      board->castle |= CASTLE_BLACK_KING;
-      break;
-    case 'q':
-      board->castle |= CASTLE_BLACK_QUEEN;
-      break;
+      instability += bestMove != NO_MOVE && bestMove != thread->pvTable[0][0] ? 2 : 0;
+      bestMove = thread->pvTable[0][0];
     }
-    fen++;
-  }
-  fen++;
-  ASSERT(board->castle >= 0 && board->castle < CASTLE_SIZE);
 
-  // En passant
-  if (*fen != '-')
-  {
-    file = fen[0] - 'a';
-    rank = fen[1] - '1';
+    if (thread->id == 0)
+    {
+      SearchThread *threads = thread;
+      u64 nodes = 0ULL;
+      for (int i = 0; i < info->threads; ++i)
+      {
+        nodes += atomic_load_explicit(&threads[i].nodes, memory_order_relaxed);
+      }
+      previousNodes = iterationNodes;
+      iterationNodes = nodes - lastNodes;
+      lastNodes = nodes;
+
+      long time = GetTimeMs() - info->startTime;
+      printf("info depth %d ", depth);
+      PrintScore(score);
+      printf(" nodes %llu nps %llu hashfull %d time %ld pv", nodes, nodes * 1000 / (time > 0 ? time : 1), GetHashFull(info->table), time);
+      for (int i = 0; i < thread->pvLength[0]; ++i)
+      {
+        printf(" %s", GetStringFromCompact(thread->pvTable[0][i]));
+      }
+      printf("\n");
+      fflush(stdout);
 
-    ASSERT(file >= FILE_A && file <= FILE_H);
-    ASSERT(rank >= RANK_1 && rank <= RANK_8);
-    board->enPassant = GetPositionFromFileRank(file, rank);
+      if (!CanStartIteration(info, nodes, iterationNodes, previousNodes, instability))
+      {
+        info->stopped = TRUE;
+      }
+    }
+
+    if (info->stopped)
+    {
+      break;
+    }
   }
+  return bestMove;
+}
 
-  // Finalize
-  board->positionKey = GeneratePositionKey(board);
-  UpdateMaterial(board);
-  return 0;
+// Thread function for lazy SMP helpers
+void *SearchHelperThread(void *arg)
+{
+  SearchIterate((SearchThread *)arg);
+  return NULL;
 }
 
-//// Print ////
+// Initialize search thread with a private copy of the board
+void InitSearchThread(SearchThread *thread, const Board *board, SearchInfo *info, int id)
+{
+  InitBoard(&thread->board);
+  CopyBoard(&thread->board, board);
+  thread->board.currentPly = 0;
+  thread->info = info;
+  thread->id = id;
+  thread->nodes = 0ULL;
+  thread->hashProbes = 0ULL;
+  thread->hashHits = 0ULL;
+  thread->bitbaseHits = 0ULL;
+  memset(thread->killers, 0, sizeof(thread->killers));
+  memset(thread->history, 0, sizeof(thread->history));
+  memset(thread->counterMoves, 0, sizeof(thread->counterMoves));
+  InitPawnTable(&thread->pawnTable);
+}
 
-// Print move key in binary
-void PrintMoveKeyInBinary(int move)
+// Free search thread
+void FreeSearchThread(SearchThread *thread)
 {
-  printf("Move key: ");
-  for (int i = 24; i >= 0; --i)
-  {
-    printf((1 << i) & move ? "1" : "0");
-    if (i == 24 || i == 20 || i == 19 || i == 18 || i == 14 || i == 7)
-    {
-      printf(" ");
-    }
-  }
-  printf("\n");
+  FreePawnTable(&thread->pawnTable);
+  FreeBoard(&thread->board);
 }
 
-// Print position board
-void PrintPositionBoard()
+// Search position with lazy SMP, the threads sharing only the transposition table
+void SearchPosition(Board *board, SearchInfo *info)
 {
-  printf("Position board:\n");
-  for (int i = 0; i < POSITION_SIZE; ++i)
+  int count = info->threads < 1 ? 1 : info->threads > MAX_THREADS ? MAX_THREADS : info->threads;
+  SearchThread *threads = malloc(count * sizeof(SearchThread));
+  pthread_t handles[MAX_THREADS];
+
+  ASSERT(CheckBoard(board));
+  ASSERT(info->depth >= 1 && info->depth < MAX_DEPTH);
+
+  info->threads = count;
+  info->nodes = 0ULL;
+  info->table->age++;
+
+  for (int i = 0; i < count; ++i)
   {
-    if (i % 10 == 0 && i > 0)
-    {
-      printf("\n");
-    }
-    printf("%5d", GetIndexFromPosition(i));
+    InitSearchThread(&threads[i], board, info, i);
+  }
+  for (int i = 1; i < count; ++i)
+  {
+    pthread_create(&handles[i], NULL, SearchHelperThread, &threads[i]);
+  }
+
+  // Helpers stop as soon as the main thread finishes
+  int bestMove = SearchIterate(&threads[0]);
+  info->stopped = TRUE;
+  for (int i = 1; i < count; ++i)
+  {
+    pthread_join(handles[i], NULL);
+  }
+
+  // Fall back to any legal move when no iteration produced one
+  if (bestMove == NO_MOVE)
+  {
+    MoveList list[1];
+    GenerateLegalMoves(board, list);
+    bestMove = list->count > 0 ? list->moves[0] : NO_MOVE;
+  }
+
+  u64 probes = 0ULL;
+  u64 hits = 0ULL;
+  u64 pawnProbes = 0ULL;
+  u64 pawnHits = 0ULL;
+  u64 bitbaseHits = 0ULL;
+  for (int i = 0; i < count; ++i)
+  {
+    bitbaseHits += threads[i].bitbaseHits;
+    probes += threads[i].hashProbes;
+    hits += threads[i].hashHits;
+    pawnProbes += threads[i].pawnTable.probes;
+    pawnHits += threads[i].pawnTable.hits;
+    FreeSearchThread(&threads[i]);
   }
+  printf("info string threads %d, hash %d MB, %llu probes, %llu hits (%llu%%)\n", count, info->table->megabytes, probes, hits, probes > 0 ? hits * 100 / probes : 0ULL);
+  printf("info string pawn table %llu probes, %llu hits (%llu%%)\n", pawnProbes, pawnHits, pawnProbes > 0 ? pawnHits * 100 / pawnProbes : 0ULL);
+  if (BitbaseCount > 0)
+  {
+    printf("info string bitbases %d loaded, %llu hits\n", BitbaseCount, bitbaseHits);
+  }
+  printf("bestmove %s\n", bestMove != NO_MOVE ? GetStringFromCompact(bestMove) : "0000");
+  fflush(stdout);
+
+  free(threads);
 }
 
-// Print index board
-void PrintIndexBoard()
+//// Benchmark ////
+
+// Check that undoing each legal move restores the accumulator without a refresh, returning the number of failed moves
+int CheckAccumulatorUndo(Board *board)
 {
-  printf("Index board:\n");
-  for (int i = 0; i < INDEX_SIZE; ++i)
+  MoveList list[1];
+  int16_t values[NNUE_HIDDEN];
+  int failed = 0;
+
+  RefreshAccumulator(board);
+  GenerateLegalMoves(board, list);
+  for (int i = 0; i < list->count; ++i)
   {
-    if (i % 8 == 0 && i > 0)
+    // Refresh the position after the move, as evaluating it in search would
+    int move = GetMoveKeyFromCompact(board, list->moves[i]);
+    MakeLegalMove(board, move);
+    RefreshAccumulator(board);
+    TakeMove(board);
+
+    int refreshed = RefreshAccumulator(board);
+    int matched = TRUE;
+    for (int perspective = WHITE; perspective <= BLACK; ++perspective)
     {
-      printf("\n");
+      ComputeAccumulator(board, perspective, values);
+      matched &= !memcmp(values, board->accumulator->values[perspective], sizeof(values));
+    }
+    if (refreshed > 0 || !matched)
+    {
+      printf("Undoing %s refreshed %d accumulator perspectives and %s a full refresh\n", GetStringFromMoveKey(move), refreshed, matched ? "matched" : "did not match");
+      failed++;
     }
-    printf("%5d", GetPositionFromIndex(i));
   }
+  return failed;
 }
 
-// Print bitboard
-void PrintBitboard(u64 key)
+// Benchmark make and unmake against copy-make with perft and a quiet fixed-depth search over the bench positions, returning the number of failed checks
+int Benchmark(Board *board, int perftDepth, int searchDepth)
 {
-  int position = 0;
-  int index = 0;
-
-  printf("Bitboard:\n");
-  for (int rank = RANK_8; rank >= RANK_1; --rank)
+  int count = sizeof(BenchPositions) / sizeof(char *);
+  int failed = 0;
+  SearchThread *thread = malloc(sizeof(SearchThread));
+  SearchInfo info[1];
+  HashTable table[1];
+
+  InitHashTable(table, BENCH_HASH_SIZE);
+  info->timeSet = FALSE;
+  info->fixedTime = FALSE;
+  info->nodeLimit = 0ULL;
+  info->threads = 1;
+  info->table = table;
+
+  for (int mode = FALSE; mode <= TRUE; ++mode)
   {
-    for (int file = FILE_A; file <= FILE_H; ++file)
+    u64 perftNodes = 0ULL;
+    u64 searchNodes = 0ULL;
+    u64 repeatedNodes = 0ULL;
+    long perftTime = 0;
+    long searchTime = 0;
+
+    CopyMake = mode;
+    for (int i = 0; i < count; ++i)
     {
-      position = GetPositionFromFileRank(file, rank);
-      index = GetIndexFromPosition(position);
-      if (key & (1ULL << index))
+      ParseFen(BenchPositions[i], board);
+      if (NnueLoaded)
       {
-        printf(" X ");
+        failed += CheckAccumulatorUndo(board);
       }
-      else
+
+      long start = GetTimeMs();
+      perftNodes += Perft(perftDepth, board, NULL);
+      perftTime += GetTimeMs() - start;
+
+      // Search from a cleared table, so that both modes visit the same nodes
+      ClearHashTable(table);
+      info->depth = searchDepth;
+      info->nodes = 0ULL;
+      info->stopped = FALSE;
+      InitSearchThread(thread, board, info, 0);
+      start = GetTimeMs();
+      u64 lastNodes = 0ULL;
+      for (int depth = 1; depth <= searchDepth; ++depth)
       {
-        printf(" - ");
+        lastNodes = thread->nodes;
+        AlphaBeta(thread, -INFINITE, INFINITE, depth);
+      }
+      searchTime += GetTimeMs() - start;
+      searchNodes += thread->nodes;
+
+      // Searching the last depth again should mostly be answered by the transposition table, once the principal variation is a small part of the tree
+      u64 nodes = thread->nodes;
+      u64 iterationNodes = nodes - lastNodes;
+      AlphaBeta(thread, -INFINITE, INFINITE, searchDepth);
+      u64 repeated = thread->nodes - nodes;
+      repeatedNodes += repeated;
+      if (searchDepth >= BENCH_REPEAT_DEPTH && repeated * BENCH_REPEAT_RATIO > iterationNodes)
+      {
+        printf("Repeated search of position %d visited %llu nodes against %llu\n", i + 1, repeated, iterationNodes);
+        failed++;
       }
+      FreeSearchThread(thread);
     }
-    printf("\n");
+
+    printf("%s: perft %llu nodes in %ld ms (%llu nps), search %llu nodes in %ld ms (%llu nps), repeated search %llu nodes\n", mode ? "Copy-make" : "Make and unmake", perftNodes, perftTime, perftNodes * 1000 / (perftTime > 0 ? perftTime : 1), searchNodes, searchTime, searchNodes * 1000 / (searchTime > 0 ? searchTime : 1), repeatedNodes);
+    fflush(stdout);
   }
+
+  CopyMake = FALSE;
+  FreeHashTable(table);
+  free(thread);
+  return failed;
 }
 
-// Print attack board
-void PrintAttackBoard(const int side, const Board *board)
+//// UCI ////
+
+// Parse move in coordinate notation against the generated moves, returning no move when none matches
+int ParseMove(const char *str, const Board *board)
 {
-  int position = 0;
+  if (str[0] < 'a' || str[0] > 'h' || str[1] < '1' || str[1] > '8' || str[2] < 'a' || str[2] > 'h' || str[3] < '1' || str[3] > '8')
+  {
+    return NO_MOVE;
+  }
 
-  printf("Attack board:\n");
-  for (int rank = RANK_8; rank >= RANK_1; --rank)
+  int from = GetPositionFromFileRank(str[0] - 'a', str[1] - '1');
+  int to = GetPositionFromFileRank(str[2] - 'a', str[3] - '1');
+  MoveList list[1];
+
+  GenerateAllMoves(board, list);
+  for (int i = 0; i < list->count; ++i)
   {
-    for (int file = FILE_A; file <= FILE_H; ++file)
+    int move = GetMoveKeyFromCompact(board, list->moves[i]);
+    if (GetFromPositionFromMoveKey(move) != from || GetToPositionFromMoveKey(move) != to)
     {
-      position = GetPositionFromFileRank(file, rank);
-      if (IsPositionAttacked(position, side, board))
-      {
-        printf(" X ");
-      }
-      else
-      {
-        printf(" - ");
-      }
+      continue;
+    }
+
+    // Promotions are written with the lowercase piece whatever the side
+    int promoted = GetPromotionFromMoveKey(move);
+    if (promoted == EMPTY || PieceCharacters[PieceColors[promoted] == WHITE ? promoted + 6 : promoted] == str[4])
+    {
+      return move;
     }
-    printf("\n");
   }
+  return NO_MOVE;
 }
 
-// Print board
-void PrintBoard(const Board *board)
+// Parse position command from the start position or a FEN, followed by moves
+void ParsePosition(char *line, Board *board)
 {
-  printf("Game board:\n\n");
+  char *moves = strstr(line, " moves ");
 
-  // Board
-  for (int rank = RANK_8; rank >= RANK_1; --rank)
+  if (!strncmp(line, "position fen ", 13))
   {
-    printf("%c ", RankCharacters[rank]);
-    for (int file = FILE_A; file <= FILE_H; ++file)
-    {
-      int index = rank * 8 + file;
-      int position = GetPositionFromIndex(index);
-      int piece = board->pieces[position];
-      printf("%3c", PieceCharacters[piece]);
-    }
-    printf("\n");
+    ParseFen(line + 13, board);
   }
-  printf("\n  ");
-  for (int file = FILE_A; file <= FILE_H; ++file)
+  else
   {
-    printf("%3c", FileCharacters[file]);
+    ParseFen(FEN_INIT, board);
   }
-  printf("\n\n");
 
-  // Statistics
-  char castleWhiteKing = board->castle & CASTLE_WHITE_KING ? 'K' : '-';
-  char castleWhiteQueen = board->castle & CASTLE_WHITE_QUEEN ? 'Q' : '-';
-  char castleBlackKing = board->castle & CASTLE_BLACK_KING ? 'k' : '-';
-  char castleBlackQueen = board->castle & CASTLE_BLACK_QUEEN ? 'q' : '-';
+  // Stop at the first unknown or illegal move
+  for (char *str = moves != NULL ? moves + 7 : NULL; str != NULL && *str != '\0'; str = strchr(str, ' '))
+  {
+    str += *str == ' ';
+    int move = ParseMove(str, board);
+    if (move == NO_MOVE || !MakeMove(board, move))
+    {
+      break;
+    }
+  }
+  board->currentPly = 0;
+}
 
-  printf("Side: %c\n", SideCharacters[board->side]);
-  printf("En passant: %d\n", board->enPassant);
-  printf("Castle: %c%c%c%c\n", castleWhiteKing, castleWhiteQueen, castleBlackKing, castleBlackQueen);
-  printf("Position key: %llX\n", board->positionKey);
+// Get integer value following a token in a line, or a default when the token is missing
+long GetTokenValue(const char *line, const char *token, long value)
+{
+  const char *found = strstr(line, token);
+  return found != NULL ? atol(found + strlen(token)) : value;
 }
 
-// Print move list
-void PrintMoveList(const MoveList *moveList)
+// Search thread started by the go command
+void *UciSearchThread(void *arg)
 {
-  int move = 0;
-  int score = 0;
-  printf("Move list:\n\n");
+  UciEngine *engine = (UciEngine *)arg;
 
-  for (int i = 0; i < moveList->count; ++i)
+  SearchPosition(&engine->board, &engine->info);
+  return NULL;
+}
+
+// Stop running search and wait for its best move
+void UciStop(UciEngine *engine)
+{
+  if (engine->searching)
   {
-    move = moveList->moves[i].move;
-    score = moveList->moves[i].score;
-    printf("Move: %d > %s (score: %d)\n", i + 1, GetStringFromMoveKey(move), score);
+    engine->info.stopped = TRUE;
+    pthread_join(engine->thread, NULL);
+    engine->searching = FALSE;
   }
-  printf("Total moves: %d\n", moveList->count);
 }
 
-//// Perft ////
-
-long leafNodes;
+// Parse go command and start searching in the background
+void ParseGo(char *line, UciEngine *engine)
+{
+  SearchInfo *info = &engine->info;
+  int side = engine->board.side;
+  long time = GetTokenValue(line, side == WHITE ? " wtime " : " btime ", -1);
+  long increment = GetTokenValue(line, side == WHITE ? " winc " : " binc ", 0);
+  long movesToGo = GetTokenValue(line, " movestogo ", 0);
+  long moveTime = GetTokenValue(line, " movetime ", -1);
+  int depth = (int)GetTokenValue(line, " depth ", MAX_DEPTH - 1);
+
+  info->startTime = GetTimeMs();
+  info->depth = depth >= 1 && depth < MAX_DEPTH ? depth : MAX_DEPTH - 1;
+  info->nodeLimit = strstr(line, " nodes ") != NULL ? strtoull(strstr(line, " nodes ") + 7, NULL, 10) : 0ULL;
+  info->stopped = FALSE;
+  SetTimeLimits(info, strstr(line, " infinite") ? -1 : time, increment, (int)movesToGo, moveTime);
+
+  engine->searching = pthread_create(&engine->thread, NULL, UciSearchThread, engine) == 0;
+}
 
-// Perft function
-void Perft(int depth, Board *board)
+// Parse setoption command
+void ParseSetOption(char *line, UciEngine *engine)
 {
-  ASSERT(CheckBoard(board));
+  char *value = strstr(line, " value ");
+  value = value != NULL ? value + 7 : line + strlen(line);
 
-  if (depth == 0)
+  if (!strncmp(line, "setoption name Hash ", 20))
   {
-    leafNodes++;
-    return;
+    int megabytes = atoi(value);
+    FreeHashTable(&engine->table);
+    InitHashTable(&engine->table, megabytes < 1 ? 1 : megabytes);
   }
-
-  MoveList list[1];
-  GenerateAllMoves(board, list);
-
-  for (int i = 0; i < list->count; ++i)
+  else if (!strncmp(line, "setoption name Threads ", 23))
+  {
+    int threads = atoi(value);
+    engine->info.threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+  }
+  else if (!strncmp(line, "setoption name EvalFile ", 24))
   {
-    if (!MakeMove(board, list->moves[i].move))
+    if (*value == '\0' || !strcmp(value, "<empty>"))
     {
-      continue;
+      NnueLoaded = FALSE;
+    }
+    else if (!LoadNetwork(value))
+    {
+      printf("info string failed to load network %s, using the classical evaluation\n", value);
+    }
+  }
+  else if (!strncmp(line, "setoption name CopyMake ", 24))
+  {
+    CopyMake = !strcmp(value, "true");
+  }
+  else if (!strncmp(line, "setoption name BitbasePath ", 27))
+  {
+    FreeBitbases();
+    if (*value != '\0' && strcmp(value, "<empty>"))
+    {
+      printf("info string %d bitbases loaded\n", LoadBitbases(value, DefaultBitbases, sizeof(DefaultBitbases) / sizeof(char *)));
     }
-    Perft(depth - 1, board);
-    TakeMove(board);
   }
+  fflush(stdout);
 }
 
-// Perft testing function
-void PerftTest(int depth, Board *board)
+// UCI loop, reading commands on the main thread while searches run on their own thread
+void UciLoop()
 {
-  ASSERT(CheckBoard(board));
-
-  PrintBoard(board);
-  printf("Start perft test with depth %d\n", depth);
-  leafNodes = 0;
-
-  MoveList list[1];
-  GenerateAllMoves(board, list);
-
-  int move;
-  for (int i = 0; i < list->count; ++i)
+  static UciEngine engine[1];
+  char line[UCI_INPUT_SIZE];
+
+  setvbuf(stdin, NULL, _IONBF, 0);
+  InitBoard(&engine->board);
+  ParseFen(FEN_INIT, &engine->board);
+  InitHashTable(&engine->table, HASH_DEFAULT_SIZE);
+  engine->info.table = &engine->table;
+  engine->info.threads = 1;
+  engine->info.stopped = TRUE;
+  engine->searching = FALSE;
+
+  while (fgets(line, sizeof(line), stdin) != NULL)
   {
-    move = list->moves[i].move;
-    if (!MakeMove(board, move))
+    line[strcspn(line, "\r\n")] = '\0';
+
+    // Stop and isready are answered while a search is running, every other command waits for it to stop
+    if (!strcmp(line, "isready"))
     {
-      continue;
+      printf("readyok\n");
     }
-
-    long curNode = leafNodes;
-    Perft(depth - 1, board);
-    TakeMove(board);
-    long prevNode = leafNodes - curNode;
-    printf("Move %d: %s with %ld nodes\n", i + 1, GetStringFromMoveKey(move), prevNode);
+    else if (!strcmp(line, "stop"))
+    {
+      UciStop(engine);
+    }
+    else if (!strcmp(line, "quit"))
+    {
+      break;
+    }
+    else if (!strcmp(line, "uci"))
+    {
+      printf("id name %s\n", NAME);
+      printf("id author %s\n", AUTHOR);
+      printf("option name Hash type spin default %d min 1 max 65536\n", HASH_DEFAULT_SIZE);
+      printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+      printf("option name EvalFile type string default <empty>\n");
+      printf("option name BitbasePath type string default <empty>\n");
+      printf("option name CopyMake type check default false\n");
+      printf("uciok\n");
+    }
+    else if (!strcmp(line, "ucinewgame"))
+    {
+      UciStop(engine);
+      ClearHashTable(&engine->table);
+      ParseFen(FEN_INIT, &engine->board);
+    }
+    else if (!strncmp(line, "position", 8))
+    {
+      UciStop(engine);
+      ParsePosition(line, &engine->board);
+    }
+    else if (!strncmp(line, "go", 2))
+    {
+      UciStop(engine);
+      ParseGo(line, engine);
+    }
+    else if (!strncmp(line, "setoption", 9))
+    {
+      UciStop(engine);
+      ParseSetOption(line, engine);
+    }
+    fflush(stdout);
   }
-  printf("Perft test complete with %ld nodes visited\n", leafNodes);
+
+  UciStop(engine);
+  FreeHashTable(&engine->table);
+  FreeBitbases();
+  FreeBoard(&engine->board);
 }
 
 //// Main ////
@@ -1720,12 +6064,110 @@ int main(int argc, char *argv[])
   // Initialize engine
   Init();
 
-  // Set up board and move list
+  // Set up board
   Board board[1];
-  MoveList list[1];
+  InitBoard(board);
   ParseFen(FEN_INIT, board);
-  PerftTest(3, board);
 
-  // Return
+  // Perft mode
+  if (argc > 1 && !strcmp(argv[1], "perft"))
+  {
+    int depth = argc > 2 ? atoi(argv[2]) : 3;
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    int hash = argc > 4 ? atoi(argv[4]) : 0;
+    PerftTable table[1];
+
+    threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+    InitPerftTable(table, hash);
+    PerftTest(depth, board, threads, hash > 0 ? table : NULL);
+    FreePerftTable(table);
+    FreeBoard(board);
+    return 0;
+  }
+
+  // Perft suite mode
+  if (argc > 2 && !strcmp(argv[1], "perft-suite"))
+  {
+    int depth = argc > 3 ? atoi(argv[3]) : MAX_PERFT_DEPTH;
+    int threads = argc > 4 ? atoi(argv[4]) : 1;
+    int hash = argc > 5 ? atoi(argv[5]) : 0;
+    PerftTable table[1];
+
+    threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+    InitPerftTable(table, hash);
+    int failed = PerftSuite(argv[2], depth, threads, hash > 0 ? table : NULL);
+    FreePerftTable(table);
+    FreeBoard(board);
+    return failed > 0;
+  }
+
+  // Search mode
+  if (argc > 1 && !strcmp(argv[1], "search"))
+  {
+    SearchInfo info[1];
+    int movetime = argc > 3 ? atoi(argv[3]) : 0;
+
+    info->startTime = GetTimeMs();
+    info->depth = argc > 2 && atoi(argv[2]) > 0 ? atoi(argv[2]) : MAX_DEPTH - 1;
+    SetTimeLimits(info, -1, 0, 0, movetime > 0 ? movetime : -1);
+    info->nodeLimit = argc > 4 ? strtoull(argv[4], NULL, 10) : 0ULL;
+    info->threads = argc > 6 ? atoi(argv[6]) : 1;
+    info->stopped = FALSE;
+
+    if (argc > 7 && !LoadNetwork(argv[7]))
+    {
+      printf("Failed to load network %s, using the classical evaluation\n", argv[7]);
+    }
+
+    if (argc > 8 && LoadBitbases(argv[8], DefaultBitbases, sizeof(DefaultBitbases) / sizeof(char *)) == 0)
+    {
+      printf("No bitbases found in %s\n", argv[8]);
+    }
+
+    HashTable table[1];
+    InitHashTable(table, argc > 5 ? atoi(argv[5]) : HASH_DEFAULT_SIZE);
+    info->table = table;
+
+    PrintBoard(board);
+    SearchPosition(board, info);
+    FreeHashTable(table);
+    FreeBitbases();
+    FreeBoard(board);
+    return 0;
+  }
+
+  // Bitbase generation mode
+  if (argc > 2 && !strcmp(argv[1], "bitbase"))
+  {
+    int threads = argc > 3 ? atoi(argv[3]) : 1;
+    char **names = argc > 4 ? argv + 4 : DefaultBitbases;
+    int count = argc > 4 ? argc - 4 : (int)(sizeof(DefaultBitbases) / sizeof(char *));
+    int failed = 0;
+
+    threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+    for (int i = 0; i < count; ++i)
+    {
+      failed += !GenerateBitbase(argv[2], names[i], threads);
+    }
+    FreeBitbases();
+    FreeBoard(board);
+    return failed > 0;
+  }
+
+  // Benchmark mode
+  if (argc > 1 && !strcmp(argv[1], "bench"))
+  {
+    if (argc > 4 && !LoadNetwork(argv[4]))
+    {
+      printf("Failed to load network %s\n", argv[4]);
+    }
+    int failed = Benchmark(board, argc > 2 ? atoi(argv[2]) : BENCH_PERFT_DEPTH, argc > 3 ? atoi(argv[3]) : BENCH_SEARCH_DEPTH);
+    FreeBoard(board);
+    return failed > 0;
+  }
+
+  // UCI mode
+  UciLoop();
+  FreeBoard(board);
   return 0;
 }
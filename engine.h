@@ -1,19 +1,76 @@
 // Include
 #pragma once
 #include "stdlib.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
 // Constants
-#define DEBUG
 #define NAME "Chess Engine"
+#define AUTHOR "onenylxus"
 
 #define POSITION_SIZE 120
 #define INDEX_SIZE 64
-#define MAX_MOVES 2048
+#define HISTORY_INITIAL_SIZE 256
+#define BENCH_PERFT_DEPTH 5
+#define BENCH_SEARCH_DEPTH 8
+#define BENCH_HASH_SIZE 16
+#define BENCH_REPEAT_RATIO 10
+#define BENCH_REPEAT_DEPTH 4
 #define MAX_CHOICES 256
 #define MAX_PIECES 10
+#define MAX_THREADS 256
+#define PERFT_BUCKET_SIZE 2
+#define MAX_PERFT_DEPTH 16
+#define MAX_FEN_LENGTH 128
+#define MAX_SUITE_POSITIONS 1024
+#define MAX_DEPTH 64
+
+#define INFINITE 30000
+#define MATE 29000
+
+#define CAPTURE_SCORE 1000000
+#define HISTORY_MAX 400000
+#define PHASE_MAX 24
+#define PAWN_TABLE_SIZE 16384
+
+#define NNUE_VERSION 0x7af32f16
+#define NNUE_PIECE_SQUARES 641
+#define NNUE_INPUTS 41024
+#define NNUE_HIDDEN 256
+#define NNUE_LAYER_SIZE 32
+#define NNUE_SHIFT 6
+#define NNUE_SCALE 16
+
+#define MAX_BITBASES 64
+#define MAX_BITBASE_PIECES 4
+#define MAX_PATH_LENGTH 1024
+#define BITBASE_MAGIC 0x42424345
+#define BITBASE_CHUNK_SIZE 4096
+#define BITBASE_SCORE 20000
+
+#define UCI_INPUT_SIZE 16384
+
+#define CHECK_INTERVAL 1024
+#define SEARCH_STAGGER 4
+#define CUCKOO_SIZE 8192
+#define TIME_MARGIN 50
+#define TIME_MOVES_TO_GO 30
+#define TIME_HARD_RATIO 4
+#define TIME_INSTABILITY_BONUS 25
+#define TIME_DEFAULT_BRANCHING 200
+
+#define HASH_BUCKET_SIZE 8
+#define HASH_KEY_MASK 0xffff800000000000ULL
+#define HASH_DEFAULT_SIZE 64
+
+#define ROOK_ATTACK_SIZE 102400
+#define BISHOP_ATTACK_SIZE 5248
 
 #define FEN_INIT "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
 
+#define NO_MOVE 0
+
 #define FLAG_EMPTY 0x0
 #define FLAG_EN_PASSANT 0x40000
 #define FLAG_CAPTURE 0x7c000
@@ -21,8 +78,13 @@
 #define FLAG_PROMOTION 0xf00000
 #define FLAG_CASTLE 0x1000000
 
+#if defined(USE_PEXT) || defined(USE_AVX2) || defined(USE_SSE41)
+#include <immintrin.h>
+#endif
+
 // Type definitions
 typedef unsigned long long u64;
+typedef uint16_t CompactMove;
 
 // Assert
 #ifndef DEBUG
@@ -40,20 +102,6 @@ typedef unsigned long long u64;
   }
 #endif
 
-// Random hash key
-#ifndef DEBUG
-#define RAND_HASH 0
-#else
-#define RAND_HASH           \
-(                           \
-  (u64)rand() +             \
-  (u64)rand() << 15 +       \
-  (u64)rand() << 30 +       \
-  (u64)rand() << 45 +       \
-  ((u64)rand() & 0xf) << 60 \
-)
-#endif
-
 // Boolean
 enum Boolean
 {
@@ -142,20 +190,96 @@ enum Castling
   CASTLE_SIZE = 16
 };
 
-// Move struct
+// Hash bounds
+enum HashBound
+{
+  BOUND_NONE,
+  BOUND_UPPER,
+  BOUND_LOWER,
+  BOUND_EXACT
+};
+
+// Bitbase values from the side to move, with draws also marking undecided positions during generation
+enum BitbaseValue
+{
+  BITBASE_DRAW,
+  BITBASE_WIN,
+  BITBASE_LOSS,
+  BITBASE_INVALID
+};
+
+// Move picker stages
+enum MoveStage
+{
+  STAGE_HASH,
+  STAGE_GENERATE_CAPTURES,
+  STAGE_CAPTURES,
+  STAGE_REFUTATIONS,
+  STAGE_GENERATE_QUIETS,
+  STAGE_QUIETS,
+  STAGE_BAD_CAPTURES,
+  STAGE_DONE
+};
+
+// Compact move types
+enum CompactMoveType
+{
+  COMPACT_NORMAL,
+  COMPACT_PROMOTION,
+  COMPACT_EN_PASSANT,
+  COMPACT_CASTLE
+};
+
+// Magic struct
 typedef struct
 {
-  int move;  // Move information
-  int score; // Move score
-} Move;
+  u64 mask;     // Relevant occupancy mask
+  u64 magic;    // Magic multiplier
+  u64 *attacks; // Attack table indexed by occupancy
+  int shift;    // Index shift
+} Magic;
 
 // Move list struct
 typedef struct
 {
-  Move moves[MAX_CHOICES]; // List of possible moves
-  int count;               // Number of possible moves
+  CompactMove moves[MAX_CHOICES]; // List of possible moves
+  int scores[MAX_CHOICES];        // Move scores
+  int count;                      // Number of possible moves
 } MoveList;
 
+// Move picker struct
+typedef struct
+{
+  MoveList list;        // Moves of the current stage
+  int index;            // Next move to pick in the list
+  int stage;            // Current stage
+  int hashMove;         // Hash move tried before generating anything
+  int refutations[3];   // Killer moves and countermove tried before the other quiet moves
+  int refutationIndex;  // Next refutation to try
+  MoveList badCaptures; // Captures losing material, tried after the quiet moves
+  int badIndex;         // Next losing capture to try
+} MovePicker;
+
+// Accumulator struct
+typedef struct
+{
+  int16_t values[SIDE_SIZE][NNUE_HIDDEN]; // Feature transformer output for each perspective
+  int dirty[SIDE_SIZE];                   // Whether a king move invalidated the perspective
+} Accumulator;
+
+// Network struct
+typedef struct
+{
+  int16_t *featureBiases;                                   // Feature transformer biases
+  int16_t *featureWeights;                                  // Feature transformer weights for each HalfKP feature
+  int32_t firstBiases[NNUE_LAYER_SIZE];                     // First dense layer biases
+  int8_t firstWeights[NNUE_LAYER_SIZE][2 * NNUE_HIDDEN];    // First dense layer weights
+  int32_t secondBiases[NNUE_LAYER_SIZE];                    // Second dense layer biases
+  int8_t secondWeights[NNUE_LAYER_SIZE][NNUE_LAYER_SIZE];   // Second dense layer weights
+  int32_t outputBias;                                       // Output layer bias
+  int8_t outputWeights[NNUE_LAYER_SIZE];                    // Output layer weights
+} Network;
+
 // Undo-move struct
 typedef struct
 {
@@ -167,10 +291,12 @@ typedef struct
 } UndoMove;
 
 // Board struct
-typedef struct
+typedef struct Board
 {
-  int pieces[POSITION_SIZE];             // Piece states of each position
+  uint8_t pieces[POSITION_SIZE];         // Piece states of each position
   u64 pawns[PLAYER_SIZE];                // Pawn positions in bit for each player
+  u64 bitboards[PIECE_SIZE];             // Piece positions in bit for each piece type
+  u64 occupancy[PLAYER_SIZE];            // Occupied positions in bit for each player
   int kingSquares[SIDE_SIZE];            // King positions for each player
   int side;                              // Current player side to move
   int castle;                            // Castle permissions
@@ -179,11 +305,190 @@ typedef struct
   int currentPly;                        // Current ply (half move)
   int historyPly;                        // History ply
   u64 positionKey;                       // Unique key for position
+  u64 pawnKey;                           // Key for pawn positions only
   int counts[PIECE_SIZE];                // Total number of pieces on the board
   int bigPieces[SIDE_SIZE];              // Number of big pieces (not pawns) on the board for each player
   int majorPieces[SIDE_SIZE];            // Number of major pieces (rooks and queens) on the board for each player
   int minorPieces[SIDE_SIZE];            // Number of minor pieces (knights and bishops) on the board for each player
   int materials[SIDE_SIZE];              // Materials for each player
-  int pieceList[PIECE_SIZE][MAX_PIECES]; // Position of each piece sorted by piece type
-  UndoMove history[MAX_MOVES];           // Move history
+  int middlegameScores[SIDE_SIZE];       // Middlegame piece-square sums for each player
+  int endgameScores[SIDE_SIZE];          // Endgame piece-square sums for each player
+  uint8_t pieceList[PIECE_SIZE][MAX_PIECES]; // Position of each piece sorted by piece type
+  Accumulator *accumulator;              // Network accumulator, updated only when a network is loaded
+  UndoMove *history;                     // Growable move history
+  int historyCapacity;                   // Moves the history can hold before growing
+  struct Board *snapshots;               // Position before each move in copy-make mode
+  Accumulator *accumulatorSnapshots;     // Accumulator before each move in copy-make mode with a network
 } Board;
+
+// Perft entry struct
+typedef struct
+{
+  u64 key;  // Position key xor data, so torn writes fail verification
+  u64 data; // Leaf nodes in the low 56 bits and depth in the high 8 bits
+} PerftEntry;
+
+// Perft table struct
+typedef struct
+{
+  PerftEntry *entries; // Buckets of depth-preferred and always-replace entries
+  u64 mask;            // Bucket count minus one
+} PerftTable;
+
+// Perft job struct
+typedef struct
+{
+  int root;  // Root move
+  int reply; // Reply move, or no move to split at the root
+  u64 nodes; // Leaf nodes below the job
+} PerftJob;
+
+// Perft worker struct
+typedef struct
+{
+  Board board;       // Private copy of the root board
+  PerftJob *jobs;    // Shared job list
+  int count;         // Number of jobs
+  int depth;         // Perft depth from the root
+  atomic_int *next;  // Shared index of the next unclaimed job
+  PerftTable *table; // Shared perft cache, or null
+  u64 nodes;         // Leaf nodes visited by this worker
+} PerftWorker;
+
+// Perft suite entry struct
+typedef struct
+{
+  char fen[MAX_FEN_LENGTH];           // Position in FEN
+  u64 expected[MAX_PERFT_DEPTH + 1];  // Expected leaf nodes for each depth, zero when not given
+  u64 results[MAX_PERFT_DEPTH + 1];   // Leaf nodes counted for each depth
+  int depth;                          // Deepest depth to run
+  u64 nodes;                          // Total leaf nodes over all depths
+  long time;                          // Time taken in milliseconds
+  int passed;                         // Whether every count matched
+} PerftSuiteEntry;
+
+// Perft suite worker struct
+typedef struct
+{
+  Board board;              // Private board
+  PerftSuiteEntry *entries; // Shared suite positions
+  int count;                // Number of positions
+  atomic_int *next;         // Shared index of the next unclaimed position
+  PerftTable *table;        // Shared perft cache, or null
+  pthread_mutex_t *lock;    // Lock for report output
+} PerftSuiteWorker;
+
+// Hash entry struct
+typedef struct
+{
+  u64 data; // Compact move in bits 0-15, score in 16-31, depth in 32-38, bound in 39-40, age in 41-46 and key in 47-63
+} HashEntry;
+
+// Hash bucket struct, filling one cache line
+typedef struct
+{
+  HashEntry entries[HASH_BUCKET_SIZE]; // Entries sharing an index
+} HashBucket;
+
+// Hash table struct
+typedef struct
+{
+  HashBucket *buckets; // Cache-line aligned buckets
+  void *memory;        // Allocation backing the buckets
+  u64 mask;            // Bucket count minus one
+  int megabytes;       // Size in megabytes
+  int age;             // Search generation used for replacement
+} HashTable;
+
+// Pawn entry struct
+typedef struct
+{
+  u64 key;        // Pawn key
+  int middlegame; // Middlegame pawn structure score for white
+  int endgame;    // Endgame pawn structure score for white
+} PawnEntry;
+
+// Pawn table struct
+typedef struct
+{
+  PawnEntry *entries; // Entries indexed by pawn key
+  u64 probes;         // Number of probes
+  u64 hits;           // Number of probes finding the pawn structure
+} PawnTable;
+
+// Bitbase struct
+typedef struct
+{
+  char name[MAX_BITBASE_PIECES + 1]; // Canonical name with the stronger side first, such as KRK
+  int pieces[MAX_BITBASE_PIECES];    // Pieces in index order, each king leading its side
+  int count;                         // Number of pieces
+  int counts[PIECE_SIZE];            // Number of each piece
+  int hasPawns;                      // Whether pawns restrict the board symmetry to file mirroring
+  u64 entries;                       // Number of indices, each holding two bits
+  const unsigned char *data;         // Packed values, four per byte
+  void *mapping;                     // Mapped file backing the values
+  size_t mappingSize;                // Size of the mapped file
+} Bitbase;
+
+// Bitbase file header struct
+typedef struct
+{
+  uint32_t magic;   // File magic
+  uint32_t version; // File format version
+  u64 entries;      // Number of indices
+} BitbaseHeader;
+
+// Bitbase worker struct
+typedef struct
+{
+  Board board;                  // Private board
+  const Bitbase *bitbase;       // Bitbase being generated
+  const unsigned char *current; // Values decided by the previous pass
+  unsigned char *updated;       // Values decided by this pass
+  atomic_ullong *next;          // Shared index of the next unclaimed chunk
+  u64 changed;                  // Positions decided by this worker
+} BitbaseWorker;
+
+// Search info struct
+typedef struct
+{
+  long startTime;      // Search start time in milliseconds
+  long softStopTime;   // Time after which no iteration starts in milliseconds
+  long stopTime;       // Time to stop searching in milliseconds
+  int timeSet;         // Whether the time limits apply
+  int fixedTime;       // Whether a fixed move time is searched until the stop time
+  int depth;           // Depth limit
+  u64 nodeLimit;       // Node limit, zero for none
+  atomic_ullong nodes; // Nodes visited by all threads, counted in batches
+  atomic_int stopped;  // Whether the search has to stop
+  int threads;         // Number of search threads
+  HashTable *table;    // Shared transposition table
+} SearchInfo;
+
+// Search thread struct
+typedef struct
+{
+  Board board;                       // Private board searched by the thread
+  SearchInfo *info;                  // Shared search limits
+  int id;                            // Thread index, zero for the main thread
+  atomic_ullong nodes;               // Nodes visited by the thread
+  u64 hashProbes;                    // Transposition table probes by the thread
+  u64 hashHits;                      // Transposition table probes finding the position
+  u64 bitbaseHits;                   // Positions resolved by bitbases
+  CompactMove pvTable[MAX_DEPTH][MAX_DEPTH]; // Triangular principal variation table
+  int pvLength[MAX_DEPTH];           // Principal variation length for each ply
+  int killers[MAX_DEPTH][2];         // Quiet moves causing a beta cutoff for each ply
+  int history[SIDE_SIZE][INDEX_SIZE][INDEX_SIZE]; // Butterfly history of quiet cutoffs by side, from and to index
+  int counterMoves[PIECE_SIZE][INDEX_SIZE];       // Quiet refutation of the previous move by its piece and to index
+  PawnTable pawnTable;               // Private pawn structure cache
+} SearchThread;
+
+// UCI engine struct
+typedef struct
+{
+  Board board;      // Position set by the last position command
+  SearchInfo info;  // Limits of the current search
+  HashTable table;  // Transposition table kept between searches
+  pthread_t thread; // Thread running the current search
+  int searching;    // Whether the search thread has to be joined
+} UciEngine;